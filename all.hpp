@@ -6,6 +6,7 @@
 #include "concepts.hpp"
 #include "debug.hpp"
 #include "dsu.hpp"
+#include "fenwick.hpp"
 #include "fluent.hpp"
 #include "graph.hpp"
 #include "hash.hpp"
@@ -23,6 +24,8 @@
 #include "treap.hpp"
 #include "types.hpp"
 #include "unordered.hpp"
+#include "wavelet.hpp"
+#include "widesegtree.hpp"
 #include "zip.hpp"
 
 #endif
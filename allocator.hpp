@@ -1,21 +1,33 @@
 #ifndef CPPCP_ALLOCATOR
 #define CPPCP_ALLOCATOR
 
+#include <algorithm>
 #include <array>
+#include <concepts>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
 
 #include "debug.hpp"
 #include "types.hpp"
 
 namespace CppCp {
 
-template <typename Allocator, typename Node, typename... Args>
-concept is_node_allocator = requires(
-    Allocator obj, Node* node, const Args... args
+// Handle is Node* or a pointer-like handle such as IndexHandle<Node>
+template <typename Allocator, typename Handle, typename... Args>
+concept is_handle_allocator = requires(
+    Allocator obj, Handle node, const Args... args
 ) {
-    { obj.alloc(args...) } -> std::same_as<Node*>;
+    { obj.alloc(args...) } -> std::same_as<Handle>;
     { obj.dealloc(node) } -> std::same_as<void>;
 };
 
+template <typename Allocator, typename Node, typename... Args>
+concept is_node_allocator = is_handle_allocator<Allocator, Node*, Args...>;
+
 template <typename Node> class DynamicAllocator {
 public:
     template <typename... T> Node* alloc(const T&... args) {
@@ -54,6 +66,159 @@ private:
     std::array<Node, Len> buffer;
 };
 
+// bump-allocates nodes from chunks of ChunkLen slots; freed slots are linked
+// through their own memory and reused first. reset() forgets every node in
+// O(1) without destroying it, keeping the chunks for reuse, so it suits
+// trivially destructible nodes or a structure that is discarded whole
+template <typename Node, usize ChunkLen = 1 << 12> class ArenaAllocator {
+public:
+    template <typename... T> Node* alloc(const T&... args) {
+        void* slot;
+        if (free_list != nullptr) {
+            slot = free_list;
+            free_list = free_list->next;
+        } else {
+            if (used == ChunkLen) {
+                if (active == std::size(chunks)) {
+                    chunks.push_back(
+                        std::make_unique_for_overwrite<Slot[]>(ChunkLen)
+                    );
+                }
+                ++active;
+                used = 0;
+            }
+            slot = &chunks[active - 1][used++];
+        }
+        return new (slot) Node(args...);
+    }
+
+    void dealloc(Node* node) {
+        node->~Node();
+        free_list = new (static_cast<void*>(node)) Free{free_list};
+    }
+
+    void reset() {
+        free_list = nullptr;
+        active = 0;
+        used = ChunkLen;
+    }
+
+private:
+    struct Free {
+        Free* next;
+    };
+
+    struct alignas(Node) alignas(Free) Slot {
+        std::byte bytes[std::max(sizeof(Node), sizeof(Free))];
+    };
+
+    std::vector<std::unique_ptr<Slot[]>> chunks;
+    usize active = 0, used = ChunkLen;
+    Free* free_list = nullptr;
+};
+
+// hands out u32 handles into one contiguous buffer instead of pointers, so
+// nodes can link to each other with 4-byte indices; handles survive growth of
+// the buffer, references obtained through operator[] do not
+template <typename Node> class IndexAllocator {
+public:
+    template <typename... T> u32 alloc(const T&... args) {
+        if (!std::empty(freed)) {
+            const u32 handle = freed.back();
+            freed.pop_back();
+            nodes[handle] = Node(args...);
+            return handle;
+        }
+        debug_assert(
+            std::size(nodes) < std::numeric_limits<u32>::max(),
+            "index allocator ran out of handles"
+        );
+        nodes.emplace_back(args...);
+        return std::size(nodes) - 1;
+    }
+
+    // the slot is reused by a later alloc rather than destroyed
+    void dealloc(const u32 handle) {
+        freed.push_back(handle);
+    }
+
+    Node& operator[](const u32 handle) {
+        return nodes[handle];
+    }
+
+    const Node& operator[](const u32 handle) const {
+        return nodes[handle];
+    }
+
+    void reserve(const usize count) {
+        nodes.reserve(count);
+    }
+
+    usize size() const {
+        return std::size(nodes);
+    }
+
+private:
+    std::vector<Node> nodes;
+    std::vector<u32> freed;
+};
+
+// pointer-like 4-byte handle into one IndexAllocator shared by every handle
+// to the same Node type; it lets pointer-based structures such as the treaps
+// link their nodes with u32 indices instead of 8-byte pointers
+template <typename Node> class IndexHandle {
+public:
+    using element_type = Node;
+
+    IndexHandle(std::nullptr_t = nullptr) : idx(NIL) {}
+
+    explicit IndexHandle(const u32 index) : idx(index) {}
+
+    Node& operator*() const {
+        debug_assert(idx != NIL, "dereferencing a nil handle");
+        return pool[idx];
+    }
+
+    Node* operator->() const {
+        debug_assert(idx != NIL, "dereferencing a nil handle");
+        return &pool[idx];
+    }
+
+    bool operator==(const IndexHandle& other) const = default;
+
+    bool operator==(std::nullptr_t) const {
+        return idx == NIL;
+    }
+
+    u32 index() const {
+        return idx;
+    }
+
+    static inline IndexAllocator<Node> pool;
+
+private:
+    static constexpr u32 NIL = std::numeric_limits<u32>::max();
+
+    u32 idx;
+};
+
+template <typename Node> class IndexHandleAllocator {
+public:
+    template <typename... T> IndexHandle<Node> alloc(const T&... args) {
+        return IndexHandle<Node>(IndexHandle<Node>::pool.alloc(args...));
+    }
+
+    void dealloc(const IndexHandle<Node> node) {
+        IndexHandle<Node>::pool.dealloc(node.index());
+    }
+};
+
+// what Allocator hands out: Node* or a pointer-like handle
+template <typename Allocator, typename... Args>
+using allocated_t = decltype(std::declval<Allocator&>().alloc(
+    std::declval<const Args&>()...
+));
+
 } // namespace CppCp
 
 #endif
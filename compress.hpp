@@ -127,6 +127,25 @@ public:
         return ret;
     }
 
+    const T& decompress(const usize idx) const {
+        debug_assert(
+            idx < std::size(store), "trying to decompress unseen index"
+        );
+        return store[idx];
+    }
+
+    // number of stored values < val, i.e. where val would compress to
+    usize lower_bound(const T& val) const {
+        return std::lower_bound(std::begin(store), std::end(store), val)
+               - std::begin(store);
+    }
+
+    // number of stored values <= val
+    usize upper_bound(const T& val) const {
+        return std::upper_bound(std::begin(store), std::end(store), val)
+               - std::begin(store);
+    }
+
     usize size() const {
         return std::size(store);
     }
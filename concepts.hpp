@@ -29,6 +29,15 @@ concept OStreamCompatibleAll = requires {
     requires((OStreamCompatible<T>) && ...);
 };
 
+template <typename T>
+concept CharLike = std::same_as<T, char> || std::same_as<T, signed char>
+                   || std::same_as<T, unsigned char>;
+
+template <typename T>
+concept HasIntegralValue = requires(const T& it) {
+    { it.value() } -> std::integral;
+};
+
 template <typename T>
 concept IndexableContainer = requires(const T& container, usize idx) {
     { container[idx] };
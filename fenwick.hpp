@@ -0,0 +1,281 @@
+#ifndef CPPCP_FENWICK
+#define CPPCP_FENWICK
+
+#include <bit>
+#include <concepts>
+#include <functional>
+#include <type_traits>
+#include <vector>
+
+#include "concepts.hpp"
+#include "debug.hpp"
+#include "types.hpp"
+
+namespace CppCp {
+
+// point update / prefix query over any associative, commutative Op; range
+// queries additionally need Op to be std::plus<> so prefixes can be
+// subtracted
+template <typename Val, typename Op = std::plus<>>
+    requires std::is_invocable_r_v<Val, Op, Val, Val>
+             && std::assignable_from<Val&, Val>
+class FenwickTree {
+public:
+    FenwickTree(const usize size, const Val& nil_value = Val())
+        : store(size + 1, nil_value),
+          nil(nil_value),
+          len(size) {}
+
+    template <typename T>
+        requires IndexableContainer<T>
+                     && std::assignable_from<Val&, decltype(T()[0])>
+    FenwickTree(const T& source, const Val& nil_value = Val())
+        : store(std::size(source) + 1, nil_value),
+          nil(nil_value),
+          len(std::ssize(source)) {
+        // every node pushes itself into its parent once, so this is O(n)
+        for (i32 i = 1; i <= len; ++i) {
+            store[i] = op(store[i], source[i - 1]);
+            const i32 parent = i + (i & -i);
+            if (parent <= len) {
+                store[parent] = op(store[parent], store[i]);
+            }
+        }
+    }
+
+    void update(const i32 pos, const Val& value) {
+        debug_assert(0 <= pos && pos < std::ssize(*this), "pos is invalid");
+        for (i32 i = pos + 1; i <= len; i += i & -i) {
+            store[i] = op(store[i], value);
+        }
+    }
+
+    // combination of [0, right]; right may be -1 for the empty prefix
+    Val prefix(const i32 right) const {
+        debug_assert(
+            -1 <= right && right < std::ssize(*this), "right pos is invalid"
+        );
+        Val ret = nil;
+        for (i32 i = right + 1; i > 0; i -= i & -i) {
+            ret = op(ret, store[i]);
+        }
+        return ret;
+    }
+
+    Val query(const i32 left, const i32 right) const
+        requires std::same_as<Op, std::plus<>>
+    {
+        debug_assert(
+            0 <= left && left < std::ssize(*this), "left pos is invalid"
+        );
+        debug_assert(
+            0 <= right && right < std::ssize(*this), "right pos is invalid"
+        );
+        debug_assert(left <= right, "left pos is > right pos");
+        return prefix(right) - prefix(left - 1);
+    }
+
+    // smallest pos such that !(prefix(pos) < value), or size() if there is
+    // none; prefixes must be non-decreasing
+    i32 lower_bound(const Val& value) const {
+        i32 pos = 0;
+        Val acc = nil;
+        for (i32 step = std::bit_floor<u32>(len); step > 0; step >>= 1) {
+            if (pos + step <= len) {
+                const Val next = op(acc, store[pos + step]);
+                if (next < value) {
+                    pos += step;
+                    acc = next;
+                }
+            }
+        }
+        return pos;
+    }
+
+    usize size() const {
+        return len;
+    }
+
+private:
+    // 1-indexed, store[i] covers (i - lowbit(i), i]
+    std::vector<Val> store;
+    const Val nil;
+    const i32 len;
+    static constexpr auto op = Op();
+};
+
+// range add / range sum through two difference trees: with d the difference
+// array, sum(0..p) = (p + 1) * sum(d[i]) - sum(d[i] * i)
+template <typename Val>
+    requires std::is_invocable_r_v<Val, std::plus<>, Val, Val>
+             && std::is_invocable_r_v<Val, std::minus<>, Val, Val>
+             && std::is_invocable_r_v<Val, std::multiplies<>, Val, Val>
+             && std::constructible_from<Val, i32>
+class RangeFenwickTree {
+public:
+    RangeFenwickTree(const usize size) : linear(size), scaled(size) {}
+
+    template <typename T>
+        requires IndexableContainer<T>
+                     && std::assignable_from<Val&, decltype(T()[0])>
+    RangeFenwickTree(const T& source)
+        : linear(differences(source, false)),
+          scaled(differences(source, true)) {}
+
+    void update(const i32 left, const i32 right, const Val& value) {
+        debug_assert(
+            0 <= left && left < std::ssize(*this), "left pos is invalid"
+        );
+        debug_assert(
+            0 <= right && right < std::ssize(*this), "right pos is invalid"
+        );
+        debug_assert(left <= right, "left pos is > right pos");
+        linear.update(left, value);
+        scaled.update(left, value * Val(left));
+        if (right + 1 < std::ssize(*this)) {
+            linear.update(right + 1, Val() - value);
+            scaled.update(right + 1, Val() - value * Val(right + 1));
+        }
+    }
+
+    Val prefix(const i32 right) const {
+        return linear.prefix(right) * Val(right + 1) - scaled.prefix(right);
+    }
+
+    Val query(const i32 left, const i32 right) const {
+        debug_assert(
+            0 <= left && left < std::ssize(*this), "left pos is invalid"
+        );
+        debug_assert(
+            0 <= right && right < std::ssize(*this), "right pos is invalid"
+        );
+        debug_assert(left <= right, "left pos is > right pos");
+        return prefix(right) - prefix(left - 1);
+    }
+
+    usize size() const {
+        return std::size(linear);
+    }
+
+private:
+    FenwickTree<Val> linear, scaled;
+
+    template <typename T>
+    static std::vector<Val> differences(const T& source, const bool scale) {
+        std::vector<Val> ret(std::size(source));
+        for (i32 i = 0; i < std::ssize(ret); ++i) {
+            ret[i] = i == 0 ? Val(source[0]) : source[i] - source[i - 1];
+            if (scale) {
+                ret[i] = ret[i] * Val(i);
+            }
+        }
+        return ret;
+    }
+};
+
+// point update / prefix-rectangle query on a rows x cols grid, stored flat
+template <typename Val, typename Op = std::plus<>>
+    requires std::is_invocable_r_v<Val, Op, Val, Val>
+             && std::assignable_from<Val&, Val>
+class FenwickTree2D {
+public:
+    FenwickTree2D(
+        const usize rows, const usize cols, const Val& nil_value = Val()
+    )
+        : store((rows + 1) * (cols + 1), nil_value),
+          nil(nil_value),
+          n(rows),
+          m(cols) {}
+
+    // source[x][y] is the value at row x, column y
+    template <typename T>
+        requires IndexableContainer<T>
+                     && IndexableContainer<decltype(T()[0])>
+                     && std::assignable_from<Val&, decltype(T()[0][0])>
+    FenwickTree2D(const T& source, const Val& nil_value = Val())
+        : nil(nil_value),
+          n(std::ssize(source)),
+          m(n > 0 ? std::ssize(source[0]) : 0) {
+        store.assign((n + 1) * (m + 1), nil);
+        for (i32 x = 1; x <= n; ++x) {
+            for (i32 y = 1; y <= m; ++y) {
+                at(x, y) = op(at(x, y), source[x - 1][y - 1]);
+            }
+        }
+        // the 1D linear build, first along every row, then every column
+        for (i32 x = 1; x <= n; ++x) {
+            for (i32 y = 1; y <= m; ++y) {
+                const i32 parent = y + (y & -y);
+                if (parent <= m) {
+                    at(x, parent) = op(at(x, parent), at(x, y));
+                }
+            }
+        }
+        for (i32 x = 1; x <= n; ++x) {
+            const i32 parent = x + (x & -x);
+            if (parent > n) {
+                continue;
+            }
+            for (i32 y = 1; y <= m; ++y) {
+                at(parent, y) = op(at(parent, y), at(x, y));
+            }
+        }
+    }
+
+    void update(const i32 x, const i32 y, const Val& value) {
+        debug_assert(0 <= x && x < n, "x is invalid");
+        debug_assert(0 <= y && y < m, "y is invalid");
+        for (i32 i = x + 1; i <= n; i += i & -i) {
+            for (i32 j = y + 1; j <= m; j += j & -j) {
+                at(i, j) = op(at(i, j), value);
+            }
+        }
+    }
+
+    // combination of [0, x] x [0, y]; either may be -1 for an empty prefix
+    Val prefix(const i32 x, const i32 y) const {
+        debug_assert(-1 <= x && x < n, "x is invalid");
+        debug_assert(-1 <= y && y < m, "y is invalid");
+        Val ret = nil;
+        for (i32 i = x + 1; i > 0; i -= i & -i) {
+            for (i32 j = y + 1; j > 0; j -= j & -j) {
+                ret = op(ret, at(i, j));
+            }
+        }
+        return ret;
+    }
+
+    Val query(const i32 x1, const i32 y1, const i32 x2, const i32 y2) const
+        requires std::same_as<Op, std::plus<>>
+    {
+        debug_assert(x1 <= x2 && y1 <= y2, "rectangle is empty");
+        return prefix(x2, y2) - prefix(x1 - 1, y2) - prefix(x2, y1 - 1)
+               + prefix(x1 - 1, y1 - 1);
+    }
+
+    usize rows() const {
+        return n;
+    }
+
+    usize cols() const {
+        return m;
+    }
+
+private:
+    std::vector<Val> store;
+    const Val nil;
+    const i32 n, m;
+    static constexpr auto op = Op();
+
+    Val& at(const i32 x, const i32 y) {
+        return store[x * (m + 1) + y];
+    }
+
+    const Val& at(const i32 x, const i32 y) const {
+        return store[x * (m + 1) + y];
+    }
+};
+
+} // namespace CppCp
+
+#endif
@@ -2,22 +2,655 @@
 #define CPPCP_IO
 
 #include <array>
+#include <bit>
+#include <charconv>
+#include <concepts>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <string_view>
+#include <tuple>
 #include <utility>
 #include <vector>
 
+#if defined(ENABLE_FAST_READER_PREFETCH) && !defined(ENABLE_FAST_READER)
+#define ENABLE_FAST_READER
+#endif
+
+#if defined(ENABLE_INTERACTIVE_IO) && !defined(ENABLE_FAST_READER)
+#define ENABLE_FAST_READER
+#endif
+
+#if defined(ENABLE_INTERACTIVE_IO) && defined(ENABLE_FAST_READER_PREFETCH)
+#error "ENABLE_INTERACTIVE_IO cannot be combined with prefetching"
+#endif
+
+#if defined(ENABLE_INTERACTIVE_IO) && __has_include(<poll.h>)
+#define CPPCP_INTERACTIVE_POLL
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#ifdef ENABLE_FAST_READER_PREFETCH
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#endif
+
+#if defined(ENABLE_FAST_READER) && defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+
+#if defined(ENABLE_FAST_READER) && !defined(DISABLE_FAST_READER_MMAP) \
+    && __has_include(<sys/mman.h>)
+#define CPPCP_FAST_READER_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "concepts.hpp"
 #include "types.hpp"
 
 namespace CppCp {
 
+#ifdef ENABLE_INTERACTIVE_IO
+inline void flush();
+#endif
+
+#ifdef ENABLE_FAST_READER
+class FastReader {
+public:
+    FastReader()
+        : buffer(CHUNK_SIZE + PADDING),
+          base(std::data(buffer)),
+          head(0),
+          tail(0),
+          eof(false) {
+        buffer[0] = '\0';
+#ifdef CPPCP_FAST_READER_MMAP
+        map_stdin();
+#endif
+#ifdef ENABLE_FAST_READER_PREFETCH
+        if (!is_mapped()) {
+            prefetcher = std::make_unique<Prefetcher>();
+        }
+#endif
+    }
+
+    ~FastReader() {
+#ifdef CPPCP_FAST_READER_MMAP
+        if (mapped_size > 0) {
+            munmap(base, mapped_size);
+        }
+#endif
+    }
+
+    template <typename T> void read(T& x) {
+        if constexpr (CharLike<T>) {
+            skip_while(is_space);
+            x = head < tail ? base[head++] : '\0';
+        } else if constexpr (std::same_as<T, bool>) {
+            u32 value;
+            read_integer(value);
+            x = value != 0;
+        } else if constexpr (std::integral<T>) {
+            read_integer(x);
+        } else if constexpr (std::floating_point<T>) {
+            auto token = read_view();
+            if (!token.empty() && token.front() == '+') {
+                token.remove_prefix(1);
+            }
+            x = T();
+            std::from_chars(
+                std::data(token), std::data(token) + std::size(token), x
+            );
+        } else if constexpr (std::same_as<T, string>) {
+            x = read_view();
+        } else if constexpr (HasIntegralValue<T>) {
+            decltype(x.value()) value;
+            read_integer(value);
+            x = T(value);
+        } else {
+            std::istringstream stream{string(read_view())};
+            stream >> x;
+        }
+    }
+
+    template <std::integral T> void read(T* out, const usize count) {
+        for (usize i = 0; i < count; ++i) {
+            if constexpr (CharLike<T> || std::same_as<T, bool>) {
+                read(out[i]);
+            } else {
+#ifdef __SSE4_1__
+                read_integer_simd(out[i]);
+#else
+                read_integer(out[i]);
+#endif
+            }
+        }
+    }
+
+    // views point into the input and stay valid until the next refill, or
+    // for the whole run when stdin is mapped
+    std::string_view read_view() {
+        skip_while(is_space);
+        return take_while([](const char c) { return !is_space(c); });
+    }
+
+    std::string_view read_line_view() {
+        skip_while([](const char c) { return c == '\n'; });
+        const auto line = take_while([](const char c) { return c != '\n'; });
+        if (head < tail) {
+            ++head;
+        }
+        return line;
+    }
+
+    bool is_mapped() const {
+#ifdef CPPCP_FAST_READER_MMAP
+        return mapped_size > 0;
+#else
+        return false;
+#endif
+    }
+
+private:
+    static constexpr usize CHUNK_SIZE = 1 << 16;
+    static constexpr usize PADDING = 64;
+
+    std::vector<char> buffer;
+    char* base;
+    usize head, tail;
+    bool eof;
+
+#ifdef ENABLE_FAST_READER_PREFETCH
+    // reads chunks of stdin on a background thread into two slots, so the
+    // kernel copy of one chunk overlaps with parsing the previous one
+    class Prefetcher {
+    public:
+        Prefetcher()
+            : chunks{
+                  std::vector<char>(CHUNK_SIZE), std::vector<char>(CHUNK_SIZE)
+              },
+              sizes{},
+              filled{},
+              next(0),
+              stopping(false),
+              worker([this] { run(); }) {}
+
+        ~Prefetcher() {
+            {
+                const std::lock_guard lock(mutex);
+                stopping = true;
+            }
+            ready.notify_all();
+            worker.join();
+        }
+
+        // copies the next chunk into dst and returns its size; a size below
+        // CHUNK_SIZE means stdin is exhausted and take must not be called
+        // again
+        usize take(char* dst) {
+            std::unique_lock lock(mutex);
+            ready.wait(lock, [&] { return filled[next]; });
+            const usize got = sizes[next];
+            lock.unlock();
+            std::memcpy(dst, std::data(chunks[next]), got);
+            lock.lock();
+            filled[next] = false;
+            next ^= 1;
+            ready.notify_all();
+            return got;
+        }
+
+    private:
+        std::array<std::vector<char>, 2> chunks;
+        std::array<usize, 2> sizes;
+        std::array<bool, 2> filled;
+        usize next;
+        bool stopping;
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::thread worker;
+
+        void run() {
+            for (usize cur = 0;; cur ^= 1) {
+                std::unique_lock lock(mutex);
+                ready.wait(lock, [&] { return !filled[cur] || stopping; });
+                if (stopping) {
+                    return;
+                }
+                lock.unlock();
+                const usize got = std::fread(
+                    std::data(chunks[cur]), 1, CHUNK_SIZE, stdin
+                );
+                lock.lock();
+                sizes[cur] = got;
+                filled[cur] = true;
+                ready.notify_all();
+                if (got < CHUNK_SIZE) {
+                    return;
+                }
+            }
+        }
+    };
+
+    std::unique_ptr<Prefetcher> prefetcher;
+#endif
+
+#ifdef ENABLE_INTERACTIVE_IO
+    // returns whatever is available instead of waiting for a full chunk, and
+    // only flushes pending output when the read is about to block on the
+    // other side
+    static usize read_interactive(char* dst) {
+#ifdef CPPCP_INTERACTIVE_POLL
+        pollfd request{STDIN_FILENO, POLLIN, 0};
+        if (poll(&request, 1, 0) <= 0) {
+            flush();
+        }
+        ssize_t got;
+        do {
+            got = ::read(STDIN_FILENO, dst, CHUNK_SIZE);
+        } while (got < 0 && errno == EINTR);
+        return got > 0 ? got : 0;
+#else
+        flush();
+        if (std::fgets(dst, CHUNK_SIZE, stdin) == nullptr) {
+            return 0;
+        }
+        return std::strlen(dst);
+#endif
+    }
+#endif
+
+#ifdef CPPCP_FAST_READER_MMAP
+    usize mapped_size = 0;
+
+    // maps a regular-file stdin as a whole so tokens are parsed straight
+    // from the page cache; pipes and ttys keep using the fread buffer
+    void map_stdin() {
+        struct stat info;
+        if (fstat(STDIN_FILENO, &info) != 0 || !S_ISREG(info.st_mode)
+            || info.st_size == 0) {
+            return;
+        }
+        const off_t offset = lseek(STDIN_FILENO, 0, SEEK_CUR);
+        if (offset < 0 || offset >= info.st_size) {
+            return;
+        }
+        const usize len = info.st_size;
+        const usize page = sysconf(_SC_PAGESIZE);
+        // one zeroed page past the end of the file keeps base[tail] == '\0'
+        // and the parsers' lookahead addressable
+        const usize reserved = (len + page - 1) / page * page + page;
+        void* region = mmap(
+            nullptr, reserved, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0
+        );
+        if (region == MAP_FAILED) {
+            return;
+        }
+        const auto flags = MAP_PRIVATE | MAP_FIXED;
+        if (mmap(region, len, PROT_READ, flags, STDIN_FILENO, 0)
+            == MAP_FAILED) {
+            munmap(region, reserved);
+            return;
+        }
+        madvise(region, len, MADV_SEQUENTIAL);
+        base = static_cast<char*>(region);
+        mapped_size = reserved;
+        head = offset;
+        tail = len;
+        eof = true;
+    }
+#endif
+
+    static bool is_space(const char c) {
+        return static_cast<u8>(c) <= ' ';
+    }
+
+    static bool is_digit(const char c) {
+        return static_cast<u8>(c - '0') < 10;
+    }
+
+    // keeps [head, tail) contiguous by moving it to the front of the buffer
+    // before reading more, so a token never straddles two reads
+    bool refill() {
+        if (eof) {
+            return false;
+        }
+        const usize remaining = tail - head;
+        std::memmove(std::data(buffer), std::data(buffer) + head, remaining);
+        head = 0;
+        tail = remaining;
+        if (tail + CHUNK_SIZE + PADDING > std::size(buffer)) {
+            buffer.resize(tail + CHUNK_SIZE + PADDING);
+        }
+        base = std::data(buffer);
+#if defined(ENABLE_INTERACTIVE_IO)
+        const usize got = read_interactive(base + tail);
+        eof = got == 0;
+#elif defined(ENABLE_FAST_READER_PREFETCH)
+        const usize got = prefetcher->take(base + tail);
+        eof = got < CHUNK_SIZE;
+#else
+        const usize got = std::fread(base + tail, 1, CHUNK_SIZE, stdin);
+        eof = got < CHUNK_SIZE;
+#endif
+        tail += got;
+        base[tail] = '\0';
+        return got > 0;
+    }
+
+    void skip_while(const auto& pred) {
+        while (true) {
+            while (head < tail && pred(base[head])) {
+                ++head;
+            }
+            if (head < tail || !refill()) {
+                return;
+            }
+        }
+    }
+
+    // refills until the run of pred starting at head ends inside the buffer
+    // (or input runs out), but never waits for input past that point
+    usize scan_while(const auto& pred) {
+        usize end = head;
+        while (true) {
+            while (end < tail && pred(base[end])) {
+                ++end;
+            }
+            if (end < tail) {
+                return end;
+            }
+            const usize offset = end - head;
+            const bool more = refill();
+            end = head + offset;
+            if (!more) {
+                return end;
+            }
+        }
+    }
+
+    std::string_view take_while(const auto& pred) {
+        const usize end = scan_while(pred);
+        const std::string_view ret(base + head, end - head);
+        head = end;
+        return ret;
+    }
+
+    template <std::integral T> void read_integer(T& x) {
+        skip_while(is_space);
+        if (tail - head < PADDING) {
+            scan_while([](const char c) { return !is_space(c); });
+        }
+        // base[tail] is always '\0', so the digit loops stop without
+        // bounds checks
+        const char* ptr = base + head;
+        bool negative = false;
+        if (*ptr == '-' || *ptr == '+') {
+            negative = *ptr == '-';
+            ++ptr;
+        }
+        T value = 0;
+        if (negative) {
+            while (is_digit(*ptr)) {
+                value = value * 10 - (*ptr++ - '0');
+            }
+        } else {
+            while (is_digit(*ptr)) {
+                value = value * 10 + (*ptr++ - '0');
+            }
+        }
+        x = value;
+        head = ptr - base;
+    }
+
+#ifdef __SSE4_1__
+    // SHIFT_DIGITS[len] moves the first len bytes of a 16-byte block to its
+    // end and zeroes the rest, so every number lines up on the ones place
+    static constexpr auto SHIFT_DIGITS = [] {
+        std::array<std::array<u8, 16>, 17> ret{};
+        for (usize len = 0; len <= 16; ++len) {
+            for (usize i = 0; i < 16; ++i) {
+                ret[len][i] = i + len >= 16 ? i + len - 16 : 0x80;
+            }
+        }
+        return ret;
+    }();
+
+    // converts up to 16 leading digits at once and finishes any longer
+    // number with the scalar loop; needs 16 readable bytes past base[tail],
+    // which PADDING (or the zeroed page after a mapping) provides
+    template <std::integral T> void read_integer_simd(T& x) {
+        while (head < tail && is_space(base[head])) {
+            ++head;
+        }
+        if (tail - head < PADDING) {
+            skip_while(is_space);
+            scan_while([](const char c) { return !is_space(c); });
+        }
+        const char* ptr = base + head;
+        bool negative = false;
+        if (*ptr == '-' || *ptr == '+') {
+            negative = *ptr == '-';
+            ++ptr;
+        }
+
+        const __m128i chunk = _mm_sub_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr)),
+            _mm_set1_epi8('0')
+        );
+        const __m128i digit_mask = _mm_cmpeq_epi8(
+            _mm_min_epu8(chunk, _mm_set1_epi8(9)), chunk
+        );
+        const u32 len = std::countr_one(
+            static_cast<u32>(_mm_movemask_epi8(digit_mask))
+        );
+        const __m128i aligned = _mm_shuffle_epi8(
+            chunk,
+            _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(std::data(SHIFT_DIGITS[len]))
+            )
+        );
+        const __m128i pairs = _mm_maddubs_epi16(
+            aligned, _mm_set1_epi16(1 << 8 | 10)
+        );
+        const __m128i quads = _mm_madd_epi16(
+            pairs, _mm_setr_epi16(100, 1, 100, 1, 100, 1, 100, 1)
+        );
+        const __m128i octets = _mm_madd_epi16(
+            _mm_packus_epi32(quads, quads),
+            _mm_setr_epi16(10000, 1, 10000, 1, 0, 0, 0, 0)
+        );
+        using Unsigned = std::make_unsigned_t<T>;
+        Unsigned value = static_cast<u64>(_mm_cvtsi128_si32(octets)) * 100000000
+                         + static_cast<u32>(_mm_extract_epi32(octets, 1));
+        ptr += len;
+        while (is_digit(*ptr)) {
+            value = value * 10 + (*ptr++ - '0');
+        }
+        x = negative ? Unsigned(0) - value : value;
+        head = ptr - base;
+    }
+#endif
+} fast_reader;
+#endif
+
+#ifdef ENABLE_FAST_WRITER
+class FastWriter {
+public:
+    FastWriter() : len(0) {}
+
+    ~FastWriter() {
+        flush();
+    }
+
+    template <typename T> void write(const T& x) {
+        if constexpr (CharLike<T>) {
+            put(static_cast<char>(x));
+        } else if constexpr (std::same_as<T, bool>) {
+            put(x ? '1' : '0');
+        } else if constexpr (std::integral<T> || std::same_as<T, i128>) {
+            write_integer(x);
+        } else if constexpr (HasIntegralValue<T>) {
+            write_integer(x.value());
+        } else if constexpr (std::convertible_to<const T&, std::string_view>) {
+            put(std::string_view(x));
+        } else {
+            fallback.str("");
+            fallback.copyfmt(std::cout);
+            fallback << x;
+            put(fallback.view());
+        }
+    }
+
+    template <typename T> void write(const std::vector<T>& values) {
+        bool first = true;
+        for (const auto& i : values) {
+            if (first) {
+                first = false;
+            } else {
+                put(' ');
+            }
+            write(i);
+        }
+    }
+
+    void flush() {
+        std::fwrite(std::data(buffer), 1, len, stdout);
+        std::fflush(stdout);
+        len = 0;
+    }
+
+private:
+    static constexpr usize BUFFER_SIZE = 1 << 16;
+    // enough room for any integer up to i128, sign included
+    static constexpr usize MAX_INTEGER_LEN = 40;
+
+    static constexpr auto DIGIT_PAIRS = [] {
+        std::array<char, 200> ret{};
+        for (i32 i = 0; i < 100; ++i) {
+            ret[2 * i] = '0' + i / 10;
+            ret[2 * i + 1] = '0' + i % 10;
+        }
+        return ret;
+    }();
+
+    std::array<char, BUFFER_SIZE> buffer;
+    usize len;
+    std::ostringstream fallback;
+
+    void put(const char c) {
+        if (len == BUFFER_SIZE) {
+            flush();
+        }
+        buffer[len++] = c;
+    }
+
+    void put(const std::string_view str) {
+        if (len + std::size(str) > BUFFER_SIZE) {
+            flush();
+            if (std::size(str) > BUFFER_SIZE) {
+                std::fwrite(std::data(str), 1, std::size(str), stdout);
+                return;
+            }
+        }
+        std::memcpy(std::data(buffer) + len, std::data(str), std::size(str));
+        len += std::size(str);
+    }
+
+    // writes the digits of value right-aligned so that they end at ptr,
+    // returning the new start
+    static char* format_digits(u64 value, char* ptr) {
+        while (value >= 100) {
+            ptr -= 2;
+            std::memcpy(ptr, std::data(DIGIT_PAIRS) + value % 100 * 2, 2);
+            value /= 100;
+        }
+        if (value >= 10) {
+            ptr -= 2;
+            std::memcpy(ptr, std::data(DIGIT_PAIRS) + value * 2, 2);
+        } else {
+            *--ptr = '0' + value;
+        }
+        return ptr;
+    }
+
+    template <typename T> void write_integer(const T x) {
+        if (len + MAX_INTEGER_LEN > BUFFER_SIZE) {
+            flush();
+        }
+        using Unsigned = std::
+            conditional_t<(sizeof(T) > sizeof(u64)), unsigned __int128, u64>;
+        Unsigned value = x;
+        if constexpr (std::same_as<T, i128> || std::is_signed_v<T>) {
+            if (x < 0) {
+                buffer[len++] = '-';
+                value = Unsigned(0) - value;
+            }
+        }
+        std::array<char, MAX_INTEGER_LEN> digits;
+        char* const end = std::data(digits) + MAX_INTEGER_LEN;
+        char* ptr;
+        if constexpr (sizeof(T) > sizeof(u64)) {
+            // peel off 19 digits at a time so the u64 path does the work
+            constexpr u64 LOW_BASE = 10'000'000'000'000'000'000ULL;
+            ptr = end;
+            while (value >= LOW_BASE) {
+                char* const low_end = ptr;
+                ptr = format_digits(static_cast<u64>(value % LOW_BASE), ptr);
+                while (low_end - ptr < 19) {
+                    *--ptr = '0';
+                }
+                value /= LOW_BASE;
+            }
+            ptr = format_digits(static_cast<u64>(value), ptr);
+        } else {
+            ptr = format_digits(value, end);
+        }
+        std::memcpy(std::data(buffer) + len, ptr, end - ptr);
+        len += end - ptr;
+    }
+} fast_writer;
+#endif
+
 namespace {
 
+template <typename T> inline void read_into(T& x) {
+#ifdef ENABLE_FAST_READER
+    fast_reader.read(x);
+#else
+    std::cin >> x;
+#endif
+}
+
+template <typename T> inline void write_value(const T& x) {
+#ifdef ENABLE_FAST_WRITER
+    fast_writer.write(x);
+#else
+    std::cout << x;
+#endif
+}
+
 template <typename T, usize... Idx>
 inline void read_tuple_helper(T& tuple, std::index_sequence<Idx...>) {
-    ((std::cin >> std::get<Idx>(tuple)), ...);
+    (read_into(std::get<Idx>(tuple)), ...);
+}
+
+template <typename T, usize... Idx>
+inline void read_columns_helper(
+    T& columns, const usize row, std::index_sequence<Idx...> seq
+) {
+    std::tuple<typename std::tuple_element_t<Idx, T>::value_type...> cells;
+    read_tuple_helper(cells, seq);
+    ((std::get<Idx>(columns)[row] = std::move(std::get<Idx>(cells))), ...);
 }
 
 } // namespace
@@ -34,7 +667,7 @@ inline std::tuple<T, U, Rest...> read() {
 
 template <IStreamCompatible T> inline T read() {
     T x;
-    std::cin >> x;
+    read_into(x);
     return x;
 }
 
@@ -58,41 +691,92 @@ inline std::vector<std::tuple<T, U, Rest...>> read(const usize count) {
     return x;
 }
 
+template <
+    IStreamCompatible T,
+    IStreamCompatible U,
+    IStreamCompatibleAll... Rest>
+inline std::tuple<std::vector<T>, std::vector<U>, std::vector<Rest>...>
+read_columns(const usize count) {
+    std::tuple<std::vector<T>, std::vector<U>, std::vector<Rest>...> x{
+        std::vector<T>(count),
+        std::vector<U>(count),
+        std::vector<Rest>(count)...
+    };
+    for (usize i = 0; i < count; ++i) {
+        read_columns_helper(x, i, std::index_sequence_for<T, U, Rest...>{});
+    }
+    return x;
+}
+
 template <IStreamCompatible T> inline std::vector<T> read(const usize count) {
     std::vector<T> x(count);
-    for (auto& i : x) {
+#ifdef ENABLE_FAST_READER
+    // std::vector<bool> has no data(), so bools go through the loop below
+    if constexpr (std::integral<T> && !std::same_as<T, bool>) {
+        fast_reader.read(std::data(x), count);
+        return x;
+    }
+#endif
+    for (auto&& i : x) {
         i = read<T>();
     }
     return x;
 }
 
 inline string read_line() {
+#ifdef ENABLE_FAST_READER
+    return string(fast_reader.read_line_view());
+#else
     string x;
     do {
         std::getline(std::cin, x);
     } while (x.length() == 0);
     return x;
+#endif
+}
+
+// with ENABLE_FAST_READER the view points into the input buffer and is only
+// valid until the reader refills it (for the whole run if stdin is mapped);
+// otherwise it is only valid until the next call
+inline std::string_view read_view() {
+#ifdef ENABLE_FAST_READER
+    return fast_reader.read_view();
+#else
+    static string token;
+    std::cin >> token;
+    return token;
+#endif
+}
+
+inline std::string_view read_line_view() {
+#ifdef ENABLE_FAST_READER
+    return fast_reader.read_line_view();
+#else
+    static string line;
+    line = read_line();
+    return line;
+#endif
 }
 
 template <bool add_space = true, OStreamCompatibleAll... T>
-inline void write(const T... args) {
+inline void write(const T&... args) {
     if constexpr (add_space) {
         bool first = true;
         const auto output_space = [&]() {
             if (first) {
                 first = false;
             } else {
-                std::cout << ' ';
+                write_value(' ');
             }
         };
-        ((output_space(), std::cout << args), ...);
+        ((output_space(), write_value(args)), ...);
     } else {
-        ((std::cout << args), ...);
+        (write_value(args), ...);
     }
 }
 
 template <bool add_space = true, OStreamCompatibleAll... T>
-inline void write_line(const T... args) {
+inline void write_line(const T&... args) {
     write<add_space>(args...);
     write('\n');
 }
@@ -100,6 +784,9 @@ inline void write_line(const T... args) {
 #define write_format(...) write(std::format(__VA_ARGS__))
 
 inline void flush() {
+#ifdef ENABLE_FAST_WRITER
+    fast_writer.flush();
+#endif
     std::cout.flush();
 }
 
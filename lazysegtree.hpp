@@ -1,12 +1,21 @@
 #ifndef CPPCP_LAZYSEGTREE
 #define CPPCP_LAZYSEGTREE
 
+#include <algorithm>
 #include <array>
+#include <bit>
 #include <concepts>
+#include <condition_variable>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <thread>
 #include <tuple>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
+#include "allocator.hpp"
 #include "concepts.hpp"
 #include "debug.hpp"
 #include "types.hpp"
@@ -24,6 +33,184 @@ inline std::tuple<i32, i32, i32> compute_indices(i32 idx, i32 l, i32 r) {
     return {lc, rc, m};
 }
 
+// post-order walk over the subtree at idx without recursion, calling
+// leaf(idx, pos) on leaves and pull(idx, lc, rc) once both children are done
+inline void build_subtree(
+    i32 idx, i32 l, i32 r, const auto& leaf, const auto& pull
+) {
+    struct Frame {
+        i32 idx, rc, m, r;
+    };
+    // the inner nodes on the current root path
+    std::array<Frame, 32> path;
+    i32 depth = 0;
+    while (true) {
+        while (r - l > 1) {
+            auto [lc, rc, m] = compute_indices(idx, l, r);
+            path[depth++] = {idx, rc, m, r};
+            idx = lc;
+            r = m;
+        }
+        // half of the inner nodes sit right above two leaves
+        if (l == r) {
+            leaf(idx, l);
+        } else {
+            leaf(idx + 1, l);
+            leaf(idx + 2, r);
+            pull(idx, idx + 1, idx + 2);
+        }
+        // climb while the finished node was a right child
+        while (depth > 0 && path[depth - 1].r == r) {
+            const Frame& parent = path[--depth];
+            pull(parent.idx, parent.idx + 1, parent.rc);
+        }
+        if (depth == 0) {
+            return;
+        }
+        const Frame& parent = path[depth - 1];
+        idx = parent.rc;
+        l = parent.m + 1;
+        r = parent.r;
+    }
+}
+
+// workers that outlive a single call, so repeated builds and batches don't
+// pay for thread creation; run(count, task) calls task(0) .. task(count - 1)
+// on the workers and the calling thread and returns once all are done. Runs
+// from different threads take turns, and a task must not call run itself
+class WorkerPool {
+public:
+    static WorkerPool& instance() {
+        static WorkerPool pool;
+        return pool;
+    }
+
+    void run(const usize count, const std::function<void(usize)>& task) {
+        const std::lock_guard turn(run_mutex);
+        {
+            const std::lock_guard lock(mutex);
+            while (std::size(workers) + 1 < count) {
+                workers.emplace_back([this] { work(); });
+            }
+            job = &task;
+            jobs = count;
+            next = 0;
+            remaining = count;
+            ++generation;
+        }
+        wake.notify_all();
+        drain();
+        std::unique_lock lock(mutex);
+        done.wait(lock, [&] { return remaining == 0; });
+        job = nullptr;
+    }
+
+    ~WorkerPool() {
+        {
+            const std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex run_mutex, mutex;
+    std::condition_variable wake, done;
+    const std::function<void(usize)>* job = nullptr;
+    usize jobs = 0, next = 0, remaining = 0;
+    u64 generation = 0;
+    bool stopping = false;
+
+    WorkerPool() {}
+
+    void drain() {
+        while (true) {
+            const std::function<void(usize)>* task;
+            usize idx;
+            {
+                const std::lock_guard lock(mutex);
+                if (next >= jobs) {
+                    return;
+                }
+                task = job;
+                idx = next++;
+            }
+            (*task)(idx);
+            const std::lock_guard lock(mutex);
+            if (--remaining == 0) {
+                done.notify_all();
+            }
+        }
+    }
+
+    void work() {
+        u64 seen = 0;
+        while (true) {
+            {
+                std::unique_lock lock(mutex);
+                wake.wait(lock, [&] {
+                    return stopping || generation != seen;
+                });
+                if (stopping) {
+                    return;
+                }
+                seen = generation;
+            }
+            drain();
+        }
+    }
+};
+
+// splits the top levels until there is a subtree per thread, builds the
+// subtrees concurrently (they own disjoint index ranges), then pulls the
+// top levels bottom-up
+inline void build_tree(
+    const i32 len, const usize threads, const auto& leaf, const auto& pull
+) {
+    if (len == 0) {
+        return;
+    }
+    std::vector<std::tuple<i32, i32, i32>> frontier{{0, 0, len - 1}}, top;
+    while (std::size(frontier) < threads) {
+        std::vector<std::tuple<i32, i32, i32>> next;
+        for (const auto& [idx, l, r] : frontier) {
+            if (l == r) {
+                next.push_back({idx, l, r});
+                continue;
+            }
+            top.push_back({idx, l, r});
+            auto [lc, rc, m] = compute_indices(idx, l, r);
+            next.push_back({lc, l, m});
+            next.push_back({rc, m + 1, r});
+        }
+        if (std::size(next) == std::size(frontier)) {
+            break;
+        }
+        frontier = std::move(next);
+    }
+    if (std::size(frontier) == 1) {
+        build_subtree(0, 0, len - 1, leaf, pull);
+        return;
+    }
+    const usize parts = std::min(threads, std::size(frontier));
+    WorkerPool::instance().run(parts, [&](const usize part) {
+        for (usize i = part; i < std::size(frontier); i += parts) {
+            const auto [idx, l, r] = frontier[i];
+            build_subtree(idx, l, r, leaf, pull);
+        }
+    });
+    // top is in BFS order, so walking it backwards sees children first
+    for (auto it = std::rbegin(top); it != std::rend(top); ++it) {
+        const auto [idx, l, r] = *it;
+        auto [lc, rc, m] = compute_indices(idx, l, r);
+        pull(idx, lc, rc);
+    }
+}
+
 } // namespace
 #endif
 
@@ -58,14 +245,15 @@ public:
     LazySegTree(
         const T& source,
         const Val& nil_value = Val(),
-        const Lazy& nil_lazy = Lazy()
+        const Lazy& nil_lazy = Lazy(),
+        const usize threads = 1
     )
         : val_store(2 * std::size(source), nil_value),
           lazy_store(2 * std::size(source), nil_lazy),
           val_nil(nil_value),
           lazy_nil(nil_lazy),
           len(std::ssize(source)) {
-        build(source, 0, 0, len - 1);
+        build(source, threads);
     }
 
     void set(const i32 pos, const Val& value) {
@@ -92,7 +280,34 @@ public:
             0 <= right && right < std::ssize(*this), "right pos is invalid"
         );
         debug_assert(left <= right, "left pos is > right pos");
-        return query(left, right, 0, 0, len - 1);
+        return query(left, right, lazy_nil, 0, 0, len - 1);
+    }
+
+    // same contract as SegTree::max_right and SegTree::min_left
+    i32 max_right(const i32 left, const auto& pred) const {
+        debug_assert(
+            0 <= left && left <= std::ssize(*this), "left pos is invalid"
+        );
+        debug_assert(pred(val_nil), "pred must hold for nil");
+        if (left == len) {
+            return left - 1;
+        }
+        Val acc = val_nil;
+        const i32 fail = max_right(left, pred, acc, lazy_nil, 0, 0, len - 1);
+        return (fail == -1 ? len : fail) - 1;
+    }
+
+    i32 min_left(const i32 right, const auto& pred) const {
+        debug_assert(
+            -1 <= right && right < std::ssize(*this), "right pos is invalid"
+        );
+        debug_assert(pred(val_nil), "pred must hold for nil");
+        if (right == -1) {
+            return 0;
+        }
+        Val acc = val_nil;
+        const i32 fail = min_left(right, pred, acc, lazy_nil, 0, 0, len - 1);
+        return fail == -1 ? 0 : fail + 1;
     }
 
     usize size() const {
@@ -100,8 +315,8 @@ public:
     }
 
 private:
-    mutable std::vector<Val> val_store;
-    mutable std::vector<Lazy> lazy_store;
+    std::vector<Val> val_store;
+    std::vector<Lazy> lazy_store;
     const Val val_nil;
     const Lazy lazy_nil;
     const i32 len;
@@ -112,18 +327,20 @@ private:
     template <typename T>
         requires IndexableContainer<T>
                  && std::assignable_from<Val&, decltype(T()[0])>
-    void build(const T& source, const i32 idx, const i32 l, const i32 r) {
-        if (l == r) {
-            val_store[idx] = source[l];
-            return;
-        }
-        auto [lc, rc, m] = compute_indices(idx, l, r);
-        build(source, lc, l, m);
-        build(source, rc, m + 1, r);
-        val_store[idx] = val_op(val_store[lc], val_store[rc]);
+    void build(const T& source, const usize threads) {
+        debug_assert(threads > 0, "thread count must be positive");
+        build_tree(
+            len,
+            // std::vector<bool> packs bits, so threads would share words
+            std::is_same_v<Val, bool> ? 1 : threads,
+            [&](const i32 idx, const i32 pos) { val_store[idx] = source[pos]; },
+            [&](const i32 idx, const i32 lc, const i32 rc) {
+                val_store[idx] = val_op(val_store[lc], val_store[rc]);
+            }
+        );
     }
 
-    void propagate(i32 idx, i32 l, i32 r) const {
+    void propagate(i32 idx, i32 l, i32 r) {
         if (lazy_store[idx] == lazy_nil) {
             return;
         }
@@ -176,17 +393,378 @@ private:
         val_store[idx] = val_op(val_store[lc], val_store[rc]);
     }
 
-    Val query(const i32 u, const i32 v, const i32 idx, const i32 l, const i32 r)
-        const {
-        propagate(idx, l, r);
+    // the tag idx would hold once its ancestors pushed theirs down, given
+    // the tag inherited from its parent
+    Lazy pending(const i32 idx, const Lazy& inherited) const {
+        if (inherited == lazy_nil) {
+            return lazy_store[idx];
+        }
+        return lazy_op(lazy_store[idx], inherited);
+    }
+
+    Val value(const i32 idx, const Lazy& tag, const i32 l, const i32 r) const {
+        if (tag == lazy_nil) {
+            return val_store[idx];
+        }
+        return apply(val_store[idx], tag, l, r);
+    }
+
+    // the read-only paths carry pending tags down instead of pushing them,
+    // so const calls never write and may run concurrently
+    Val query(
+        const i32 u,
+        const i32 v,
+        const Lazy& inherited,
+        const i32 idx,
+        const i32 l,
+        const i32 r
+    ) const {
         if (u > r || v < l) {
             return val_nil;
         }
+        const Lazy tag = pending(idx, inherited);
         if (u <= l && v >= r) {
-            return val_store[idx];
+            return value(idx, tag, l, r);
+        }
+        auto [lc, rc, m] = compute_indices(idx, l, r);
+        return val_op(
+            query(u, v, tag, lc, l, m), query(u, v, tag, rc, m + 1, r)
+        );
+    }
+    i32 max_right(
+        const i32 u,
+        const auto& pred,
+        Val& acc,
+        const Lazy& inherited,
+        const i32 idx,
+        const i32 l,
+        const i32 r
+    ) const {
+        if (r < u) {
+            return -1;
+        }
+        const Lazy tag = pending(idx, inherited);
+        if (u <= l) {
+            const auto combined = val_op(acc, value(idx, tag, l, r));
+            if (pred(combined)) {
+                acc = combined;
+                return -1;
+            }
+            if (l == r) {
+                return l;
+            }
+        }
+        auto [lc, rc, m] = compute_indices(idx, l, r);
+        const i32 fail = max_right(u, pred, acc, tag, lc, l, m);
+        if (fail != -1) {
+            return fail;
+        }
+        return max_right(u, pred, acc, tag, rc, m + 1, r);
+    }
+
+    i32 min_left(
+        const i32 v,
+        const auto& pred,
+        Val& acc,
+        const Lazy& inherited,
+        const i32 idx,
+        const i32 l,
+        const i32 r
+    ) const {
+        if (l > v) {
+            return -1;
+        }
+        const Lazy tag = pending(idx, inherited);
+        if (r <= v) {
+            const auto combined = val_op(value(idx, tag, l, r), acc);
+            if (pred(combined)) {
+                acc = combined;
+                return -1;
+            }
+            if (l == r) {
+                return l;
+            }
         }
         auto [lc, rc, m] = compute_indices(idx, l, r);
-        return val_op(query(u, v, lc, l, m), query(u, v, rc, m + 1, r));
+        const i32 fail = min_left(v, pred, acc, tag, rc, m + 1, r);
+        if (fail != -1) {
+            return fail;
+        }
+        return min_left(v, pred, acc, tag, lc, l, m);
+    }
+};
+
+// bottom-up counterpart of LazySegTree over a power-of-two layout: every
+// operation pushes tags down the two boundary paths, works on the canonical
+// nodes between them, then pulls the same paths back up; lazy_store[idx]
+// holds the tag still owed to the children of idx
+template <
+    typename Val,
+    typename Lazy,
+    typename Apply,
+    typename ValOp = std::plus<>,
+    typename LazyOp = std::plus<>>
+    requires std::is_invocable_r_v<Val, ValOp, Val, Val>
+             && std::assignable_from<Val&, Val>
+             && std::is_invocable_r_v<Lazy, LazyOp, Lazy, Lazy>
+             && std::assignable_from<Lazy&, Lazy>
+             && std::equality_comparable<Lazy>
+             && std::is_invocable_r_v<Val, Apply, Val, Lazy, i32, i32>
+class IterativeLazySegTree {
+public:
+    IterativeLazySegTree(
+        const usize size,
+        const Val& nil_value = Val(),
+        const Lazy& nil_lazy = Lazy()
+    )
+        : val_store(2 * std::bit_ceil(size), nil_value),
+          lazy_store(std::bit_ceil(size), nil_lazy),
+          val_nil(nil_value),
+          lazy_nil(nil_lazy),
+          len(size),
+          cap(std::bit_ceil(size)),
+          height(std::countr_zero(std::bit_ceil(size))) {}
+
+    template <typename T>
+        requires IndexableContainer<T>
+                     && std::assignable_from<Val&, decltype(T()[0])>
+    IterativeLazySegTree(
+        const T& source,
+        const Val& nil_value = Val(),
+        const Lazy& nil_lazy = Lazy()
+    )
+        : val_store(2 * std::bit_ceil(std::size(source)), nil_value),
+          lazy_store(std::bit_ceil(std::size(source)), nil_lazy),
+          val_nil(nil_value),
+          lazy_nil(nil_lazy),
+          len(std::ssize(source)),
+          cap(std::bit_ceil(std::size(source))),
+          height(std::countr_zero(std::bit_ceil(std::size(source)))) {
+        for (i32 i = 0; i < len; ++i) {
+            val_store[cap + i] = source[i];
+        }
+        for (i32 i = cap - 1; i > 0; --i) {
+            pull(i);
+        }
+    }
+
+    void set(const i32 pos, const Val& value) {
+        debug_assert(0 <= pos && pos < std::ssize(*this), "pos is invalid");
+        const i32 idx = pos + cap;
+        for (i32 h = height; h > 0; --h) {
+            push(idx >> h, h);
+        }
+        val_store[idx] = value;
+        for (i32 h = 1; h <= height; ++h) {
+            pull(idx >> h);
+        }
+    }
+
+    void update(const i32 left, const i32 right, const Lazy& lazy) {
+        debug_assert(
+            0 <= left && left < std::ssize(*this), "left pos is invalid"
+        );
+        debug_assert(
+            0 <= right && right < std::ssize(*this), "right pos is invalid"
+        );
+        debug_assert(left <= right, "left pos is > right pos");
+        const i32 l = left + cap, r = right + cap + 1;
+        push_boundaries(l, r);
+        for (i32 a = l, b = r, h = 0; a < b; a /= 2, b /= 2, ++h) {
+            if (a & 1) {
+                apply_node(a++, lazy, h);
+            }
+            if (b & 1) {
+                apply_node(--b, lazy, h);
+            }
+        }
+        // only ancestors of a partially covered node need recomputing
+        for (i32 h = 1; h <= height; ++h) {
+            if (((l >> h) << h) != l) {
+                pull(l >> h);
+            }
+            if (((r >> h) << h) != r) {
+                pull((r - 1) >> h);
+            }
+        }
+    }
+
+    Val query(const i32 left, const i32 right) const {
+        debug_assert(
+            0 <= left && left < std::ssize(*this), "left pos is invalid"
+        );
+        debug_assert(
+            0 <= right && right < std::ssize(*this), "right pos is invalid"
+        );
+        debug_assert(left <= right, "left pos is > right pos");
+        const i32 l = left + cap, r = right + cap + 1;
+        // every canonical node hangs off one of the two boundary paths
+        const auto left_tags = path_tags(l), right_tags = path_tags(r - 1);
+        Val left_acc = val_nil, right_acc = val_nil;
+        for (i32 a = l, b = r, h = 0; a < b; a /= 2, b /= 2, ++h) {
+            if (a & 1) {
+                left_acc = val_op(left_acc, value(a++, left_tags[h + 1]));
+            }
+            if (b & 1) {
+                right_acc = val_op(value(--b, right_tags[h + 1]), right_acc);
+            }
+        }
+        return val_op(left_acc, right_acc);
+    }
+
+    i32 max_right(const i32 left, const auto& pred) const {
+        debug_assert(
+            0 <= left && left <= std::ssize(*this), "left pos is invalid"
+        );
+        debug_assert(pred(val_nil), "pred must hold for nil");
+        if (left == len) {
+            return left - 1;
+        }
+        i32 idx = left + cap;
+        const auto tags = path_tags(idx);
+        Val acc = val_nil;
+        do {
+            while (idx % 2 == 0) {
+                idx /= 2;
+            }
+            Lazy tag = tags[level(idx) + 1];
+            Val val = value(idx, tag);
+            if (!pred(val_op(acc, val))) {
+                while (idx < cap) {
+                    tag = pending(idx, tag);
+                    idx *= 2;
+                    val = value(idx, tag);
+                    if (pred(val_op(acc, val))) {
+                        acc = val_op(acc, val);
+                        ++idx;
+                    }
+                }
+                return idx - cap - 1;
+            }
+            acc = val_op(acc, val);
+            ++idx;
+        } while (!std::has_single_bit(static_cast<u32>(idx)));
+        return len - 1;
+    }
+
+    i32 min_left(const i32 right, const auto& pred) const {
+        debug_assert(
+            -1 <= right && right < std::ssize(*this), "right pos is invalid"
+        );
+        debug_assert(pred(val_nil), "pred must hold for nil");
+        if (right == -1) {
+            return 0;
+        }
+        i32 idx = right + cap + 1;
+        const auto tags = path_tags(idx - 1);
+        Val acc = val_nil;
+        do {
+            --idx;
+            while (idx > 1 && idx % 2 == 1) {
+                idx /= 2;
+            }
+            Lazy tag = tags[level(idx) + 1];
+            Val val = value(idx, tag);
+            if (!pred(val_op(val, acc))) {
+                while (idx < cap) {
+                    tag = pending(idx, tag);
+                    idx = 2 * idx + 1;
+                    val = value(idx, tag);
+                    if (pred(val_op(val, acc))) {
+                        acc = val_op(val, acc);
+                        --idx;
+                    }
+                }
+                return idx + 1 - cap;
+            }
+            acc = val_op(val, acc);
+        } while (!std::has_single_bit(static_cast<u32>(idx)));
+        return 0;
+    }
+
+    usize size() const {
+        return len;
+    }
+
+private:
+    std::vector<Val> val_store;
+    std::vector<Lazy> lazy_store;
+    const Val val_nil;
+    const Lazy lazy_nil;
+    const i32 len;
+    const i32 cap;
+    const i32 height;
+    static constexpr auto val_op = ValOp();
+    static constexpr auto lazy_op = LazyOp();
+    static constexpr auto apply = Apply();
+
+    void pull(const i32 idx) {
+        val_store[idx] = val_op(val_store[2 * idx], val_store[2 * idx + 1]);
+    }
+
+    // height of idx above the leaves
+    i32 level(const i32 idx) const {
+        return height + 1 - std::bit_width(static_cast<u32>(idx));
+    }
+
+    Lazy pending(const i32 idx, const Lazy& inherited) const {
+        if (inherited == lazy_nil) {
+            return lazy_store[idx];
+        }
+        return lazy_op(lazy_store[idx], inherited);
+    }
+
+    // tags[h] is what the ancestor of leaf h levels up owes its children,
+    // counting what is still owed to that ancestor; tags deeper on a path
+    // are always older, so composing them top-down needs no writes
+    std::array<Lazy, 32> path_tags(const i32 leaf) const {
+        std::array<Lazy, 32> tags;
+        tags[height + 1] = lazy_nil;
+        for (i32 h = height; h > 0; --h) {
+            tags[h] = pending(leaf >> h, tags[h + 1]);
+        }
+        return tags;
+    }
+
+    Val value(const i32 idx, const Lazy& tag) const {
+        if (tag == lazy_nil) {
+            return val_store[idx];
+        }
+        const i32 h = level(idx);
+        const i32 l = (idx << h) - cap;
+        return apply(val_store[idx], tag, l, l + (1 << h) - 1);
+    }
+
+    // applies lazy to the whole segment of idx, which sits h levels above
+    // the leaves, and owes it to the children
+    void apply_node(const i32 idx, const Lazy& lazy, const i32 h) {
+        const i32 l = (idx << h) - cap;
+        val_store[idx] = apply(val_store[idx], lazy, l, l + (1 << h) - 1);
+        if (h > 0) {
+            lazy_store[idx] = lazy_op(lazy_store[idx], lazy);
+        }
+    }
+
+    // a tag is only ever placed on fully covered nodes, so nodes straddling
+    // the padding past len keep a nil tag and Apply never sees it
+    void push(const i32 idx, const i32 h) {
+        if (lazy_store[idx] == lazy_nil) {
+            return;
+        }
+        apply_node(2 * idx, lazy_store[idx], h - 1);
+        apply_node(2 * idx + 1, lazy_store[idx], h - 1);
+        lazy_store[idx] = lazy_nil;
+    }
+
+    void push_boundaries(const i32 l, const i32 r) {
+        for (i32 h = height; h > 0; --h) {
+            if (((l >> h) << h) != l) {
+                push(l >> h, h);
+            }
+            if (((r >> h) << h) != r) {
+                push((r - 1) >> h, h);
+            }
+        }
     }
 };
 
@@ -252,7 +830,33 @@ public:
             0 <= right && right < std::ssize(*this), "right pos is invalid"
         );
         debug_assert(left <= right, "left pos is > right pos");
-        return query(left, right, 0, 0, Size - 1);
+        return query(left, right, lazy_nil, 0, 0, Size - 1);
+    }
+
+    i32 max_right(const i32 left, const auto& pred) const {
+        debug_assert(
+            0 <= left && left <= std::ssize(*this), "left pos is invalid"
+        );
+        debug_assert(pred(val_nil), "pred must hold for nil");
+        if (left == std::ssize(*this)) {
+            return left - 1;
+        }
+        Val acc = val_nil;
+        const i32 fail = max_right(left, pred, acc, lazy_nil, 0, 0, Size - 1);
+        return (fail == -1 ? static_cast<i32>(Size) : fail) - 1;
+    }
+
+    i32 min_left(const i32 right, const auto& pred) const {
+        debug_assert(
+            -1 <= right && right < std::ssize(*this), "right pos is invalid"
+        );
+        debug_assert(pred(val_nil), "pred must hold for nil");
+        if (right == -1) {
+            return 0;
+        }
+        Val acc = val_nil;
+        const i32 fail = min_left(right, pred, acc, lazy_nil, 0, 0, Size - 1);
+        return fail == -1 ? 0 : fail + 1;
     }
 
     usize size() const {
@@ -260,8 +864,8 @@ public:
     }
 
 private:
-    mutable std::array<Val, 2 * Size> val_store;
-    mutable std::array<Lazy, 2 * Size> lazy_store;
+    std::array<Val, 2 * Size> val_store;
+    std::array<Lazy, 2 * Size> lazy_store;
     const Val val_nil;
     const Lazy lazy_nil;
     static constexpr auto val_op = ValOp();
@@ -282,7 +886,7 @@ private:
         val_store[idx] = val_op(val_store[lc], val_store[rc]);
     }
 
-    void propagate(i32 idx, i32 l, i32 r) const {
+    void propagate(i32 idx, i32 l, i32 r) {
         if (lazy_store[idx] == lazy_nil) {
             return;
         }
@@ -335,17 +939,657 @@ private:
         val_store[idx] = val_op(val_store[lc], val_store[rc]);
     }
 
-    Val query(const i32 u, const i32 v, const i32 idx, const i32 l, const i32 r)
-        const {
-        propagate(idx, l, r);
+    // the tag idx would hold once its ancestors pushed theirs down, given
+    // the tag inherited from its parent
+    Lazy pending(const i32 idx, const Lazy& inherited) const {
+        if (inherited == lazy_nil) {
+            return lazy_store[idx];
+        }
+        return lazy_op(lazy_store[idx], inherited);
+    }
+
+    Val value(const i32 idx, const Lazy& tag, const i32 l, const i32 r) const {
+        if (tag == lazy_nil) {
+            return val_store[idx];
+        }
+        return apply(val_store[idx], tag, l, r);
+    }
+
+    // the read-only paths carry pending tags down instead of pushing them,
+    // so const calls never write and may run concurrently
+    Val query(
+        const i32 u,
+        const i32 v,
+        const Lazy& inherited,
+        const i32 idx,
+        const i32 l,
+        const i32 r
+    ) const {
         if (u > r || v < l) {
             return val_nil;
         }
+        const Lazy tag = pending(idx, inherited);
         if (u <= l && v >= r) {
-            return val_store[idx];
+            return value(idx, tag, l, r);
+        }
+        auto [lc, rc, m] = compute_indices(idx, l, r);
+        return val_op(
+            query(u, v, tag, lc, l, m), query(u, v, tag, rc, m + 1, r)
+        );
+    }
+    i32 max_right(
+        const i32 u,
+        const auto& pred,
+        Val& acc,
+        const Lazy& inherited,
+        const i32 idx,
+        const i32 l,
+        const i32 r
+    ) const {
+        if (r < u) {
+            return -1;
+        }
+        const Lazy tag = pending(idx, inherited);
+        if (u <= l) {
+            const auto combined = val_op(acc, value(idx, tag, l, r));
+            if (pred(combined)) {
+                acc = combined;
+                return -1;
+            }
+            if (l == r) {
+                return l;
+            }
         }
         auto [lc, rc, m] = compute_indices(idx, l, r);
-        return val_op(query(u, v, lc, l, m), query(u, v, rc, m + 1, r));
+        const i32 fail = max_right(u, pred, acc, tag, lc, l, m);
+        if (fail != -1) {
+            return fail;
+        }
+        return max_right(u, pred, acc, tag, rc, m + 1, r);
+    }
+
+    i32 min_left(
+        const i32 v,
+        const auto& pred,
+        Val& acc,
+        const Lazy& inherited,
+        const i32 idx,
+        const i32 l,
+        const i32 r
+    ) const {
+        if (l > v) {
+            return -1;
+        }
+        const Lazy tag = pending(idx, inherited);
+        if (r <= v) {
+            const auto combined = val_op(value(idx, tag, l, r), acc);
+            if (pred(combined)) {
+                acc = combined;
+                return -1;
+            }
+            if (l == r) {
+                return l;
+            }
+        }
+        auto [lc, rc, m] = compute_indices(idx, l, r);
+        const i32 fail = min_left(v, pred, acc, tag, rc, m + 1, r);
+        if (fail != -1) {
+            return fail;
+        }
+        return min_left(v, pred, acc, tag, lc, l, m);
+    }
+};
+
+// versioned LazySegTree: set and update path-copy, pushing tags into fresh
+// copies of the children they pass, and return a new version; queries
+// compose the tags on their way down and never write. A node's val already
+// includes its own tag, and its lazy is the tag owed to its children.
+// With Commute, for tags that commute with each other such as range add,
+// updates leave tags where they are and only copy the visited nodes, at the
+// cost of set
+template <
+    typename Val,
+    typename Lazy,
+    typename Apply,
+    typename ValOp = std::plus<>,
+    typename LazyOp = std::plus<>,
+    bool Commute = false>
+    requires std::is_invocable_r_v<Val, ValOp, Val, Val>
+             && std::assignable_from<Val&, Val>
+             && std::is_invocable_r_v<Lazy, LazyOp, Lazy, Lazy>
+             && std::assignable_from<Lazy&, Lazy>
+             && std::equality_comparable<Lazy>
+             && std::is_invocable_r_v<Val, Apply, Val, Lazy, i32, i32>
+class PersistentLazySegTree {
+public:
+    PersistentLazySegTree(
+        const usize size,
+        const Val& nil_value = Val(),
+        const Lazy& nil_lazy = Lazy()
+    )
+        : val_nil(nil_value),
+          lazy_nil(nil_lazy),
+          len(size) {
+        nodes.alloc(val_nil, lazy_nil, 0u, 0u);
+        roots.push_back(0);
+    }
+
+    template <typename T>
+        requires IndexableContainer<T>
+                     && std::assignable_from<Val&, decltype(T()[0])>
+    PersistentLazySegTree(
+        const T& source,
+        const Val& nil_value = Val(),
+        const Lazy& nil_lazy = Lazy()
+    )
+        : val_nil(nil_value),
+          lazy_nil(nil_lazy),
+          len(std::ssize(source)) {
+        nodes.reserve(2 * len);
+        nodes.alloc(val_nil, lazy_nil, 0u, 0u);
+        roots.push_back(len > 0 ? build(source, 0, len - 1) : 0);
+    }
+
+    // returns the version made by setting pos to value in version
+    i32 set(const i32 version, const i32 pos, const Val& value)
+        requires(!Commute)
+    {
+        debug_assert(
+            0 <= version && version < std::ssize(roots), "version is invalid"
+        );
+        debug_assert(0 <= pos && pos < std::ssize(*this), "pos is invalid");
+        roots.push_back(set(pos, value, lazy_nil, roots[version], 0, len - 1));
+        return std::ssize(roots) - 1;
+    }
+
+    // returns the version made by applying lazy to [left, right] in version
+    i32 update(
+        const i32 version, const i32 left, const i32 right, const Lazy& lazy
+    ) {
+        debug_assert(
+            0 <= version && version < std::ssize(roots), "version is invalid"
+        );
+        debug_assert(
+            0 <= left && left < std::ssize(*this), "left pos is invalid"
+        );
+        debug_assert(
+            0 <= right && right < std::ssize(*this), "right pos is invalid"
+        );
+        debug_assert(left <= right, "left pos is > right pos");
+        roots.push_back(
+            update(left, right, lazy, lazy_nil, roots[version], 0, len - 1)
+        );
+        return std::ssize(roots) - 1;
+    }
+
+    Val query(const i32 version, const i32 left, const i32 right) const {
+        debug_assert(
+            0 <= version && version < std::ssize(roots), "version is invalid"
+        );
+        debug_assert(
+            0 <= left && left < std::ssize(*this), "left pos is invalid"
+        );
+        debug_assert(
+            0 <= right && right < std::ssize(*this), "right pos is invalid"
+        );
+        debug_assert(left <= right, "left pos is > right pos");
+        return query(left, right, lazy_nil, roots[version], 0, len - 1);
+    }
+
+    // preallocates node storage for the given number of future mutations,
+    // each of which visits, and so copies, at most 4 nodes per level
+    void reserve(const usize mutations) {
+        nodes.reserve(
+            std::size(nodes) + mutations * 4 * (std::bit_width<u32>(len) + 1)
+        );
+    }
+
+    usize versions() const {
+        return std::size(roots);
+    }
+
+    usize size() const {
+        return len;
+    }
+
+private:
+    struct Node {
+        Val val;
+        Lazy lazy;
+        u32 left, right;
+    };
+
+    // node 0 stands for every all-nil subtree, so a missing child is just 0
+    IndexAllocator<Node> nodes;
+    std::vector<u32> roots;
+    const Val val_nil;
+    const Lazy lazy_nil;
+    const i32 len;
+    static constexpr auto val_op = ValOp();
+    static constexpr auto lazy_op = LazyOp();
+    static constexpr auto apply = Apply();
+
+    template <typename T>
+        requires IndexableContainer<T>
+                 && std::assignable_from<Val&, decltype(T()[0])>
+    u32 build(const T& source, const i32 l, const i32 r) {
+        if (l == r) {
+            return nodes.alloc(Val(source[l]), lazy_nil, 0u, 0u);
+        }
+        const i32 m = l + (r - l) / 2;
+        const u32 lc = build(source, l, m);
+        const u32 rc = build(source, m + 1, r);
+        return pull(lc, rc);
+    }
+
+    u32 pull(const u32 lc, const u32 rc) {
+        const Val val = val_op(nodes[lc].val, nodes[rc].val);
+        return nodes.alloc(val, lazy_nil, lc, rc);
+    }
+
+    // idx with lazy applied to its whole segment, copied only if lazy is
+    // not nil
+    u32 applied(const u32 idx, const Lazy& lazy, const i32 l, const i32 r) {
+        if (lazy == lazy_nil) {
+            return idx;
+        }
+        Node node = nodes[idx];
+        node.val = apply(node.val, lazy, l, r);
+        if (l != r) {
+            node.lazy = lazy_op(node.lazy, lazy);
+        }
+        return nodes.alloc(node);
+    }
+
+    // the tag idx owes its children once pending, owed to idx itself by its
+    // parent, is taken into account
+    Lazy owed(const u32 idx, const Lazy& pending) const {
+        if (pending == lazy_nil) {
+            return nodes[idx].lazy;
+        }
+        return lazy_op(nodes[idx].lazy, pending);
+    }
+
+    // mutations carry the parent's owed tag down instead of materializing
+    // pushed children, so every visited node is copied once
+    u32 set(
+        const i32 u,
+        const Val& w,
+        const Lazy& pending,
+        const u32 idx,
+        const i32 l,
+        const i32 r
+    ) {
+        if (l == r) {
+            return nodes.alloc(w, lazy_nil, 0u, 0u);
+        }
+        const Lazy tag = owed(idx, pending);
+        const u32 left = nodes[idx].left, right = nodes[idx].right;
+        const i32 m = l + (r - l) / 2;
+        if (u <= m) {
+            const u32 lc = set(u, w, tag, left, l, m);
+            return pull(lc, applied(right, tag, m + 1, r));
+        }
+        const u32 lc = applied(left, tag, l, m);
+        return pull(lc, set(u, w, tag, right, m + 1, r));
+    }
+
+    u32 update(
+        const i32 u,
+        const i32 v,
+        const Lazy& w,
+        const Lazy& pending,
+        const u32 idx,
+        const i32 l,
+        const i32 r
+    ) {
+        if (u > r || v < l) {
+            return applied(idx, pending, l, r);
+        }
+        if (u <= l && v >= r) {
+            const Lazy tag = pending == lazy_nil ? w : lazy_op(pending, w);
+            return applied(idx, tag, l, r);
+        }
+        const i32 m = l + (r - l) / 2;
+        const u32 left = nodes[idx].left, right = nodes[idx].right;
+        if constexpr (Commute) {
+            // the tag stays here and is reapplied over the new children
+            const Lazy tag = nodes[idx].lazy;
+            const u32 lc = update(u, v, w, lazy_nil, left, l, m);
+            const u32 rc = update(u, v, w, lazy_nil, right, m + 1, r);
+            const Val val = val_op(nodes[lc].val, nodes[rc].val);
+            if (tag == lazy_nil) {
+                return nodes.alloc(val, lazy_nil, lc, rc);
+            }
+            return nodes.alloc(apply(val, tag, l, r), tag, lc, rc);
+        } else {
+            const Lazy tag = owed(idx, pending);
+            const u32 lc = update(u, v, w, tag, left, l, m);
+            const u32 rc = update(u, v, w, tag, right, m + 1, r);
+            return pull(lc, rc);
+        }
+    }
+
+    Val query(
+        const i32 u,
+        const i32 v,
+        const Lazy& inherited,
+        const u32 idx,
+        const i32 l,
+        const i32 r
+    ) const {
+        if (u > r || v < l) {
+            return val_nil;
+        }
+        const Node& node = nodes[idx];
+        if (u <= l && v >= r) {
+            if (inherited == lazy_nil) {
+                return node.val;
+            }
+            return apply(node.val, inherited, l, r);
+        }
+        const Lazy tag = owed(idx, inherited);
+        const i32 m = l + (r - l) / 2;
+        return val_op(
+            query(u, v, tag, node.left, l, m),
+            query(u, v, tag, node.right, m + 1, r)
+        );
+    }
+};
+
+// segment tree beats: every node keeps its max, strict second max and max
+// count (and the same for min), so range chmin/chmax only recurse while
+// they would change more than the extreme values; amortised O(log^2 n) per
+// operation together with range add; Sum may be wider than Val
+template <typename Val, typename Sum = Val>
+    requires std::is_arithmetic_v<Val> && std::is_arithmetic_v<Sum>
+class BeatsSegTree {
+public:
+    BeatsSegTree(const usize size) : store(2 * size), len(size) {
+        build_tree(
+            len,
+            1,
+            [&](const i32 idx, const i32) { make_leaf(idx, Val()); },
+            [&](const i32 idx, const i32 lc, const i32 rc) {
+                pull(idx, lc, rc);
+            }
+        );
+    }
+
+    template <typename T>
+        requires IndexableContainer<T>
+                     && std::assignable_from<Val&, decltype(T()[0])>
+    BeatsSegTree(const T& source, const usize threads = 1)
+        : store(2 * std::size(source)),
+          len(std::ssize(source)) {
+        debug_assert(threads > 0, "thread count must be positive");
+        build_tree(
+            len,
+            threads,
+            [&](const i32 idx, const i32 pos) { make_leaf(idx, source[pos]); },
+            [&](const i32 idx, const i32 lc, const i32 rc) {
+                pull(idx, lc, rc);
+            }
+        );
+    }
+
+    // a[i] = min(a[i], value) for i in [left, right]
+    void chmin(const i32 left, const i32 right, const Val& value) {
+        check_range(left, right);
+        chmin(left, right, value, 0, 0, len - 1);
+    }
+
+    // a[i] = max(a[i], value) for i in [left, right]
+    void chmax(const i32 left, const i32 right, const Val& value) {
+        check_range(left, right);
+        chmax(left, right, value, 0, 0, len - 1);
+    }
+
+    // a[i] += value for i in [left, right]
+    void add(const i32 left, const i32 right, const Val& value) {
+        check_range(left, right);
+        add(left, right, value, 0, 0, len - 1);
+    }
+
+    Sum query_sum(const i32 left, const i32 right) const {
+        check_range(left, right);
+        return query<&Node::sum>(
+            left, right, store[0], 0, 0, len - 1, Sum(), std::plus<>()
+        );
+    }
+
+    Val query_min(const i32 left, const i32 right) const {
+        check_range(left, right);
+        return query<&Node::min1>(
+            left, right, store[0], 0, 0, len - 1, HIGHEST, [](Val a, Val b) {
+                return std::min(a, b);
+            }
+        );
+    }
+
+    Val query_max(const i32 left, const i32 right) const {
+        check_range(left, right);
+        return query<&Node::max1>(
+            left, right, store[0], 0, 0, len - 1, LOWEST, [](Val a, Val b) {
+                return std::max(a, b);
+            }
+        );
+    }
+
+    usize size() const {
+        return len;
+    }
+
+private:
+    struct Node {
+        Sum sum;
+        Val max1, max2, min1, min2, add;
+        i32 max_count, min_count;
+    };
+
+    // stand-ins for a missing second max/min
+    static constexpr Val LOWEST = std::numeric_limits<Val>::lowest();
+    static constexpr Val HIGHEST = std::numeric_limits<Val>::max();
+
+    std::vector<Node> store;
+    const i32 len;
+
+    void check_range(const i32 left, const i32 right) const {
+        debug_assert(
+            0 <= left && left < std::ssize(*this), "left pos is invalid"
+        );
+        debug_assert(
+            0 <= right && right < std::ssize(*this), "right pos is invalid"
+        );
+        debug_assert(left <= right, "left pos is > right pos");
+    }
+
+    void make_leaf(const i32 idx, const Val& value) {
+        store[idx] = {Sum(value), value, LOWEST, value, HIGHEST, Val(), 1, 1};
+    }
+
+    void pull(const i32 idx, const i32 lc, const i32 rc) {
+        const Node &a = store[lc], &b = store[rc];
+        Node& node = store[idx];
+        node.sum = a.sum + b.sum;
+        if (a.max1 == b.max1) {
+            node.max1 = a.max1;
+            node.max2 = std::max(a.max2, b.max2);
+            node.max_count = a.max_count + b.max_count;
+        } else {
+            const Node& hi = a.max1 > b.max1 ? a : b;
+            const Node& lo = a.max1 > b.max1 ? b : a;
+            node.max1 = hi.max1;
+            node.max2 = std::max(hi.max2, lo.max1);
+            node.max_count = hi.max_count;
+        }
+        if (a.min1 == b.min1) {
+            node.min1 = a.min1;
+            node.min2 = std::min(a.min2, b.min2);
+            node.min_count = a.min_count + b.min_count;
+        } else {
+            const Node& lo = a.min1 < b.min1 ? a : b;
+            const Node& hi = a.min1 < b.min1 ? b : a;
+            node.min1 = lo.min1;
+            node.min2 = std::min(lo.min2, hi.min1);
+            node.min_count = lo.min_count;
+        }
+    }
+
+    static void
+    apply_add(Node& node, const i32 l, const i32 r, const Val& value) {
+        node.sum += Sum(value) * (r - l + 1);
+        node.max1 += value;
+        node.min1 += value;
+        if (node.max2 != LOWEST) {
+            node.max2 += value;
+        }
+        if (node.min2 != HIGHEST) {
+            node.min2 += value;
+        }
+        node.add += value;
+    }
+
+    // lowers the max of node to value; requires max2 < value < max1
+    static void apply_chmin(Node& node, const Val& value) {
+        node.sum -= Sum(node.max1 - value) * node.max_count;
+        if (node.min1 == node.max1) {
+            node.min1 = value;
+        } else if (node.min2 == node.max1) {
+            node.min2 = value;
+        }
+        node.max1 = value;
+    }
+
+    // raises the min of node to value; requires min1 < value < min2
+    static void apply_chmax(Node& node, const Val& value) {
+        node.sum += Sum(value - node.min1) * node.min_count;
+        if (node.max1 == node.min1) {
+            node.max1 = value;
+        } else if (node.max2 == node.min1) {
+            node.max2 = value;
+        }
+        node.min1 = value;
+    }
+
+    // children only ever lag behind their parent by the pending add and by
+    // a clamp of their extremes to the parent's; catch child up to parent
+    static void
+    catch_up(Node& child, const Node& parent, const i32 l, const i32 r) {
+        if (parent.add != Val()) {
+            apply_add(child, l, r, parent.add);
+        }
+        if (child.max1 > parent.max1) {
+            apply_chmin(child, parent.max1);
+        }
+        if (child.min1 < parent.min1) {
+            apply_chmax(child, parent.min1);
+        }
+    }
+
+    void propagate(const i32 idx, const i32 l, const i32 r) {
+        if (l == r) {
+            return;
+        }
+        const auto [lc, rc, m] = compute_indices(idx, l, r);
+        catch_up(store[lc], store[idx], l, m);
+        catch_up(store[rc], store[idx], m + 1, r);
+        store[idx].add = Val();
+    }
+
+    void chmin(
+        const i32 u,
+        const i32 v,
+        const Val& w,
+        const i32 idx,
+        const i32 l,
+        const i32 r
+    ) {
+        if (u > r || v < l || store[idx].max1 <= w) {
+            return;
+        }
+        if (u <= l && v >= r && (store[idx].max2 < w || l == r)) {
+            apply_chmin(store[idx], w);
+            return;
+        }
+        propagate(idx, l, r);
+        auto [lc, rc, m] = compute_indices(idx, l, r);
+        chmin(u, v, w, lc, l, m);
+        chmin(u, v, w, rc, m + 1, r);
+        pull(idx, lc, rc);
+    }
+
+    void chmax(
+        const i32 u,
+        const i32 v,
+        const Val& w,
+        const i32 idx,
+        const i32 l,
+        const i32 r
+    ) {
+        if (u > r || v < l || store[idx].min1 >= w) {
+            return;
+        }
+        if (u <= l && v >= r && (store[idx].min2 > w || l == r)) {
+            apply_chmax(store[idx], w);
+            return;
+        }
+        propagate(idx, l, r);
+        auto [lc, rc, m] = compute_indices(idx, l, r);
+        chmax(u, v, w, lc, l, m);
+        chmax(u, v, w, rc, m + 1, r);
+        pull(idx, lc, rc);
+    }
+
+    void add(
+        const i32 u,
+        const i32 v,
+        const Val& w,
+        const i32 idx,
+        const i32 l,
+        const i32 r
+    ) {
+        if (u > r || v < l) {
+            return;
+        }
+        if (u <= l && v >= r) {
+            apply_add(store[idx], l, r, w);
+            return;
+        }
+        propagate(idx, l, r);
+        auto [lc, rc, m] = compute_indices(idx, l, r);
+        add(u, v, w, lc, l, m);
+        add(u, v, w, rc, m + 1, r);
+        pull(idx, lc, rc);
+    }
+
+    // node is what store[idx] would hold after pushing every ancestor; the
+    // children are caught up in copies, so queries never write
+    template <auto field, typename T>
+    T query(
+        const i32 u,
+        const i32 v,
+        const Node& node,
+        const i32 idx,
+        const i32 l,
+        const i32 r,
+        const T& nil,
+        const auto& combine
+    ) const {
+        if (u > r || v < l) {
+            return nil;
+        }
+        if (u <= l && v >= r) {
+            return node.*field;
+        }
+        auto [lc, rc, m] = compute_indices(idx, l, r);
+        Node left = store[lc], right = store[rc];
+        catch_up(left, node, l, m);
+        catch_up(right, node, m + 1, r);
+        return combine(
+            query<field>(u, v, left, lc, l, m, nil, combine),
+            query<field>(u, v, right, rc, m + 1, r, nil, combine)
+        );
     }
 };
 
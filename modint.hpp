@@ -78,6 +78,10 @@ public:
 #endif
     }
 
+    T value() const {
+        return rep;
+    }
+
     std::strong_ordering operator<=>(const ModInt& other) const {
         return rep <=> other.rep;
     }
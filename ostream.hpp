@@ -1,11 +1,27 @@
 #ifndef CPPCP_OSTREAM
 #define CPPCP_OSTREAM
 
+#include <array>
 #include <ostream>
 
 #include "types.hpp"
 
 namespace CppCp {
+inline std::ostream& operator<<(std::ostream& stream, const i128 value) {
+    unsigned __int128 rest = value < 0 ? -(unsigned __int128)value : value;
+    char digits[40];
+    char* ptr = digits + sizeof(digits);
+    do {
+        *--ptr = '0' + rest % 10;
+        rest /= 10;
+    } while (rest > 0);
+    if (value < 0) {
+        *--ptr = '-';
+    }
+    stream.write(ptr, digits + sizeof(digits) - ptr);
+    return stream;
+}
+
 template <typename T, typename U>
 std::ostream& operator<<(
     std::ostream& stream, const std::pair<T, U>& pair
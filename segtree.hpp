@@ -1,12 +1,24 @@
 #ifndef CPPCP_SEGTREE
 #define CPPCP_SEGTREE
 
+#include <algorithm>
 #include <array>
+#include <bit>
 #include <concepts>
+#include <condition_variable>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <numeric>
+#include <span>
+#include <thread>
 #include <tuple>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
+#include "allocator.hpp"
+#include "compress.hpp"
 #include "concepts.hpp"
 #include "debug.hpp"
 #include "types.hpp"
@@ -24,9 +36,192 @@ inline std::tuple<i32, i32, i32> compute_indices(i32 idx, i32 l, i32 r) {
     return {lc, rc, m};
 }
 
+// post-order walk over the subtree at idx without recursion, calling
+// leaf(idx, pos) on leaves and pull(idx, lc, rc) once both children are done
+inline void build_subtree(
+    i32 idx, i32 l, i32 r, const auto& leaf, const auto& pull
+) {
+    struct Frame {
+        i32 idx, rc, m, r;
+    };
+    // the inner nodes on the current root path
+    std::array<Frame, 32> path;
+    i32 depth = 0;
+    while (true) {
+        while (r - l > 1) {
+            auto [lc, rc, m] = compute_indices(idx, l, r);
+            path[depth++] = {idx, rc, m, r};
+            idx = lc;
+            r = m;
+        }
+        // half of the inner nodes sit right above two leaves
+        if (l == r) {
+            leaf(idx, l);
+        } else {
+            leaf(idx + 1, l);
+            leaf(idx + 2, r);
+            pull(idx, idx + 1, idx + 2);
+        }
+        // climb while the finished node was a right child
+        while (depth > 0 && path[depth - 1].r == r) {
+            const Frame& parent = path[--depth];
+            pull(parent.idx, parent.idx + 1, parent.rc);
+        }
+        if (depth == 0) {
+            return;
+        }
+        const Frame& parent = path[depth - 1];
+        idx = parent.rc;
+        l = parent.m + 1;
+        r = parent.r;
+    }
+}
+
+// workers that outlive a single call, so repeated builds and batches don't
+// pay for thread creation; run(count, task) calls task(0) .. task(count - 1)
+// on the workers and the calling thread and returns once all are done. Runs
+// from different threads take turns, and a task must not call run itself
+class WorkerPool {
+public:
+    static WorkerPool& instance() {
+        static WorkerPool pool;
+        return pool;
+    }
+
+    void run(const usize count, const std::function<void(usize)>& task) {
+        const std::lock_guard turn(run_mutex);
+        {
+            const std::lock_guard lock(mutex);
+            while (std::size(workers) + 1 < count) {
+                workers.emplace_back([this] { work(); });
+            }
+            job = &task;
+            jobs = count;
+            next = 0;
+            remaining = count;
+            ++generation;
+        }
+        wake.notify_all();
+        drain();
+        std::unique_lock lock(mutex);
+        done.wait(lock, [&] { return remaining == 0; });
+        job = nullptr;
+    }
+
+    ~WorkerPool() {
+        {
+            const std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex run_mutex, mutex;
+    std::condition_variable wake, done;
+    const std::function<void(usize)>* job = nullptr;
+    usize jobs = 0, next = 0, remaining = 0;
+    u64 generation = 0;
+    bool stopping = false;
+
+    WorkerPool() {}
+
+    void drain() {
+        while (true) {
+            const std::function<void(usize)>* task;
+            usize idx;
+            {
+                const std::lock_guard lock(mutex);
+                if (next >= jobs) {
+                    return;
+                }
+                task = job;
+                idx = next++;
+            }
+            (*task)(idx);
+            const std::lock_guard lock(mutex);
+            if (--remaining == 0) {
+                done.notify_all();
+            }
+        }
+    }
+
+    void work() {
+        u64 seen = 0;
+        while (true) {
+            {
+                std::unique_lock lock(mutex);
+                wake.wait(lock, [&] {
+                    return stopping || generation != seen;
+                });
+                if (stopping) {
+                    return;
+                }
+                seen = generation;
+            }
+            drain();
+        }
+    }
+};
+
+// splits the top levels until there is a subtree per thread, builds the
+// subtrees concurrently (they own disjoint index ranges), then pulls the
+// top levels bottom-up
+inline void build_tree(
+    const i32 len, const usize threads, const auto& leaf, const auto& pull
+) {
+    if (len == 0) {
+        return;
+    }
+    std::vector<std::tuple<i32, i32, i32>> frontier{{0, 0, len - 1}}, top;
+    while (std::size(frontier) < threads) {
+        std::vector<std::tuple<i32, i32, i32>> next;
+        for (const auto& [idx, l, r] : frontier) {
+            if (l == r) {
+                next.push_back({idx, l, r});
+                continue;
+            }
+            top.push_back({idx, l, r});
+            auto [lc, rc, m] = compute_indices(idx, l, r);
+            next.push_back({lc, l, m});
+            next.push_back({rc, m + 1, r});
+        }
+        if (std::size(next) == std::size(frontier)) {
+            break;
+        }
+        frontier = std::move(next);
+    }
+    if (std::size(frontier) == 1) {
+        build_subtree(0, 0, len - 1, leaf, pull);
+        return;
+    }
+    const usize parts = std::min(threads, std::size(frontier));
+    WorkerPool::instance().run(parts, [&](const usize part) {
+        for (usize i = part; i < std::size(frontier); i += parts) {
+            const auto [idx, l, r] = frontier[i];
+            build_subtree(idx, l, r, leaf, pull);
+        }
+    });
+    // top is in BFS order, so walking it backwards sees children first
+    for (auto it = std::rbegin(top); it != std::rend(top); ++it) {
+        const auto [idx, l, r] = *it;
+        auto [lc, rc, m] = compute_indices(idx, l, r);
+        pull(idx, lc, rc);
+    }
+}
+
 } // namespace
 #endif
 
+// PreOrder keeps each subtree contiguous (the compute_indices layout), while
+// Eytzinger stores nodes in BFS order so the top levels share a few cache
+// lines and siblings sit next to each other
+enum class SegTreeLayout { PreOrder, Eytzinger };
+
 template <typename Val, typename Op = std::plus<>>
     requires std::is_invocable_r_v<Val, Op, Val, Val>
              && std::assignable_from<Val&, Val>
@@ -40,11 +235,13 @@ public:
     template <typename T>
         requires IndexableContainer<T>
                      && std::assignable_from<Val&, decltype(T()[0])>
-    SegTree(const T& source, const Val& nil_value = Val())
+    SegTree(
+        const T& source, const Val& nil_value = Val(), const usize threads = 1
+    )
         : store(2 * std::size(source)),
           nil(nil_value),
           len(std::ssize(source)) {
-        build(source, 0, 0, len - 1);
+        build(source, threads);
     }
 
     void set(const i32 pos, const Val& value) {
@@ -68,6 +265,70 @@ public:
         return query(left, right, 0, 0, len - 1);
     }
 
+    // largest right in [left - 1, size - 1] such that pred holds for
+    // query(left, right); pred must hold for nil and be monotone
+    i32 max_right(const i32 left, const auto& pred) const {
+        debug_assert(
+            0 <= left && left <= std::ssize(*this), "left pos is invalid"
+        );
+        debug_assert(pred(nil), "pred must hold for nil");
+        if (left == len) {
+            return left - 1;
+        }
+        Val acc = nil;
+        const i32 fail = max_right(left, pred, acc, 0, 0, len - 1);
+        return (fail == -1 ? len : fail) - 1;
+    }
+
+    // smallest left in [0, right + 1] such that pred holds for
+    // query(left, right); pred must hold for nil and be monotone
+    i32 min_left(const i32 right, const auto& pred) const {
+        debug_assert(
+            -1 <= right && right < std::ssize(*this), "right pos is invalid"
+        );
+        debug_assert(pred(nil), "pred must hold for nil");
+        if (right == -1) {
+            return 0;
+        }
+        Val acc = nil;
+        const i32 fail = min_left(right, pred, acc, 0, 0, len - 1);
+        return fail == -1 ? 0 : fail + 1;
+    }
+
+    // answers query(queries[i].first, queries[i].second) into out[i]; the
+    // queries are bucketed by left pos so consecutive walks share cache lines,
+    // then split across threads of the shared WorkerPool that each run lanes
+    // walks in lockstep to overlap their cache misses
+    template <usize lanes = 1>
+        requires(lanes > 0)
+    void query_batch(
+        const std::span<const std::pair<i32, i32>> queries,
+        const std::span<Val> out,
+        const usize threads = 1
+    ) const {
+        debug_assert(
+            std::size(out) >= std::size(queries), "out span is too small"
+        );
+        debug_assert(threads > 0, "thread count must be positive");
+        const std::vector<u32> order = bucket_by_left(queries);
+        const usize chunk = (std::size(order) + threads - 1) / threads;
+        if (threads == 1 || chunk < lanes) {
+            walk_batch<lanes>(queries, out, order);
+            return;
+        }
+        const usize parts = (std::size(order) + chunk - 1) / chunk;
+        WorkerPool::instance().run(parts, [&](const usize part) {
+            const usize from = part * chunk;
+            walk_batch<lanes>(
+                queries,
+                out,
+                std::span(order).subspan(
+                    from, std::min(chunk, std::size(order) - from)
+                )
+            );
+        });
+    }
+
     usize size() const {
         return len;
     }
@@ -81,15 +342,17 @@ private:
     template <typename T>
         requires IndexableContainer<T>
                  && std::assignable_from<Val&, decltype(T()[0])>
-    void build(const T& source, const i32 idx, const i32 l, const i32 r) {
-        if (l == r) {
-            store[idx] = source[l];
-            return;
-        }
-        auto [lc, rc, m] = compute_indices(idx, l, r);
-        build(source, lc, l, m);
-        build(source, rc, m + 1, r);
-        store[idx] = op(store[lc], store[rc]);
+    void build(const T& source, const usize threads) {
+        debug_assert(threads > 0, "thread count must be positive");
+        build_tree(
+            len,
+            // std::vector<bool> packs bits, so threads would share words
+            std::is_same_v<Val, bool> ? 1 : threads,
+            [&](const i32 idx, const i32 pos) { store[idx] = source[pos]; },
+            [&](const i32 idx, const i32 lc, const i32 rc) {
+                store[idx] = op(store[lc], store[rc]);
+            }
+        );
     }
 
     template <bool replace>
@@ -127,9 +390,616 @@ private:
         auto [lc, rc, m] = compute_indices(idx, l, r);
         return op(query(u, v, lc, l, m), query(u, v, rc, m + 1, r));
     }
+    // returns the first position >= u where pred fails once folded into acc,
+    // or -1 if there is none inside [l, r]
+    i32 max_right(
+        const i32 u,
+        const auto& pred,
+        Val& acc,
+        const i32 idx,
+        const i32 l,
+        const i32 r
+    ) const {
+        if (r < u) {
+            return -1;
+        }
+        if (u <= l) {
+            const auto combined = op(acc, store[idx]);
+            if (pred(combined)) {
+                acc = combined;
+                return -1;
+            }
+            if (l == r) {
+                return l;
+            }
+        }
+        auto [lc, rc, m] = compute_indices(idx, l, r);
+        const i32 fail = max_right(u, pred, acc, lc, l, m);
+        if (fail != -1) {
+            return fail;
+        }
+        return max_right(u, pred, acc, rc, m + 1, r);
+    }
+
+    // returns the last position <= v where pred fails once folded into acc,
+    // or -1 if there is none inside [l, r]
+    i32 min_left(
+        const i32 v,
+        const auto& pred,
+        Val& acc,
+        const i32 idx,
+        const i32 l,
+        const i32 r
+    ) const {
+        if (l > v) {
+            return -1;
+        }
+        if (r <= v) {
+            const auto combined = op(store[idx], acc);
+            if (pred(combined)) {
+                acc = combined;
+                return -1;
+            }
+            if (l == r) {
+                return l;
+            }
+        }
+        auto [lc, rc, m] = compute_indices(idx, l, r);
+        const i32 fail = min_left(v, pred, acc, rc, m + 1, r);
+        if (fail != -1) {
+            return fail;
+        }
+        return min_left(v, pred, acc, lc, l, m);
+    }
+
+    // counting sort of query indices by left pos, with about one bucket per
+    // query
+    std::vector<u32> bucket_by_left(
+        const std::span<const std::pair<i32, i32>> queries
+    ) const {
+        const i32 len_bits = std::bit_width<u32>(len);
+        const i32 count_bits = std::bit_width(std::size(queries));
+        const i32 shift = std::max(0, len_bits - count_bits);
+        std::vector<u32> start(((std::max(len, 1) - 1) >> shift) + 2);
+        for (const auto& [u, v] : queries) {
+            debug_assert(0 <= u && u <= v && v < len, "query is invalid");
+            ++start[(u >> shift) + 1];
+        }
+        for (usize i = 1; i < std::size(start); ++i) {
+            start[i] += start[i - 1];
+        }
+        std::vector<u32> order(std::size(queries));
+        for (usize i = 0; i < std::size(queries); ++i) {
+            order[start[queries[i].first >> shift]++] = i;
+        }
+        return order;
+    }
+
+    // a query [u, v] descends to the node where it splits, then folds the
+    // right children hanging off the path to u and the left children hanging
+    // off the path to v; each walk is a small state machine advanced by one
+    // node per step, so several can be interleaved without a stack
+    template <usize lanes>
+    void walk_batch(
+        const std::span<const std::pair<i32, i32>> queries,
+        const std::span<Val> out,
+        const std::span<const u32> order
+    ) const {
+        enum class Phase : u8 { Idle, Split, LeftPath, RightPath };
+        struct Walk {
+            i32 idx, l, r, u, v;
+            i32 right_idx, right_l, right_r;
+            Phase phase;
+            u32 slot;
+        };
+        std::array<Walk, lanes> walks{};
+        std::vector<Val> left_accs(lanes, nil), right_accs(lanes, nil);
+
+        usize next = 0, active = 0;
+        const auto start = [&](const usize k) {
+            if (next == std::size(order)) {
+                walks[k].phase = Phase::Idle;
+                return false;
+            }
+            const u32 slot = order[next++];
+            const auto [u, v] = queries[slot];
+            walks[k] = {0, 0, len - 1, u, v, 0, 0, 0, Phase::Split, slot};
+            left_accs[k] = nil;
+            right_accs[k] = nil;
+            return true;
+        };
+        for (usize k = 0; k < lanes; ++k) {
+            active += start(k);
+        }
+        while (active > 0) {
+            for (usize k = 0; k < lanes; ++k) {
+                Walk& walk = walks[k];
+                const i32 idx = walk.idx, l = walk.l, r = walk.r;
+                const i32 u = walk.u, v = walk.v;
+                const Phase phase = walk.phase;
+                if (phase == Phase::Idle) {
+                    continue;
+                }
+                bool done = false;
+                if (phase == Phase::Split) {
+                    auto [lc, rc, m] = compute_indices(idx, l, r);
+                    if (u <= l && r <= v) {
+                        left_accs[k] = store[idx];
+                        done = true;
+                    } else if (v <= m) {
+                        walk.idx = lc;
+                        walk.r = m;
+                    } else if (u > m) {
+                        walk.idx = rc;
+                        walk.l = m + 1;
+                    } else {
+                        walk.right_idx = rc;
+                        walk.right_l = m + 1;
+                        walk.right_r = r;
+                        walk.idx = lc;
+                        walk.r = m;
+                        walk.phase = Phase::LeftPath;
+                        __builtin_prefetch(&store[rc]);
+                    }
+                } else if (phase == Phase::LeftPath) {
+                    auto [lc, rc, m] = compute_indices(idx, l, r);
+                    if (u <= l) {
+                        left_accs[k] = op(store[idx], left_accs[k]);
+                        walk.idx = walk.right_idx;
+                        walk.l = walk.right_l;
+                        walk.r = walk.right_r;
+                        walk.phase = Phase::RightPath;
+                    } else if (u <= m) {
+                        left_accs[k] = op(store[rc], left_accs[k]);
+                        walk.idx = lc;
+                        walk.r = m;
+                    } else {
+                        walk.idx = rc;
+                        walk.l = m + 1;
+                    }
+                } else {
+                    auto [lc, rc, m] = compute_indices(idx, l, r);
+                    if (r <= v) {
+                        right_accs[k] = op(right_accs[k], store[idx]);
+                        done = true;
+                    } else if (v > m) {
+                        right_accs[k] = op(right_accs[k], store[lc]);
+                        walk.idx = rc;
+                        walk.l = m + 1;
+                    } else {
+                        walk.idx = lc;
+                        walk.r = m;
+                    }
+                }
+                if (done) {
+                    out[walk.slot] = op(left_accs[k], right_accs[k]);
+                    active -= !start(k);
+                } else {
+                    __builtin_prefetch(&store[walk.idx]);
+                }
+            }
+        }
+    }
+};
+
+// every set or update path-copies O(log n) nodes and returns a new version,
+// leaving all older versions queryable
+template <typename Val, typename Op = std::plus<>>
+    requires std::is_invocable_r_v<Val, Op, Val, Val>
+             && std::assignable_from<Val&, Val>
+class PersistentSegTree {
+public:
+    PersistentSegTree(const usize size, const Val& nil_value = Val())
+        : nil(nil_value),
+          len(size) {
+        nodes.alloc(nil, 0u, 0u);
+        roots.push_back(0);
+    }
+
+    template <typename T>
+        requires IndexableContainer<T>
+                     && std::assignable_from<Val&, decltype(T()[0])>
+    PersistentSegTree(const T& source, const Val& nil_value = Val())
+        : nil(nil_value),
+          len(std::ssize(source)) {
+        nodes.reserve(2 * len);
+        nodes.alloc(nil, 0u, 0u);
+        roots.push_back(len > 0 ? build(source, 0, len - 1) : 0);
+    }
+
+    // returns the version made by setting pos to value in version
+    i32 set(const i32 version, const i32 pos, const Val& value) {
+        debug_assert(
+            0 <= version && version < std::ssize(roots), "version is invalid"
+        );
+        debug_assert(0 <= pos && pos < std::ssize(*this), "pos is invalid");
+        roots.push_back(mutate<true>(roots[version], pos, value, 0, len - 1));
+        return std::ssize(roots) - 1;
+    }
+
+    // returns the version made by combining value into pos in version
+    i32 update(const i32 version, const i32 pos, const Val& value) {
+        debug_assert(
+            0 <= version && version < std::ssize(roots), "version is invalid"
+        );
+        debug_assert(0 <= pos && pos < std::ssize(*this), "pos is invalid");
+        roots.push_back(mutate<false>(roots[version], pos, value, 0, len - 1)
+        );
+        return std::ssize(roots) - 1;
+    }
+
+    Val query(const i32 version, const i32 left, const i32 right) const {
+        debug_assert(
+            0 <= version && version < std::ssize(roots), "version is invalid"
+        );
+        debug_assert(
+            0 <= left && left < std::ssize(*this), "left pos is invalid"
+        );
+        debug_assert(
+            0 <= right && right < std::ssize(*this), "right pos is invalid"
+        );
+        debug_assert(left <= right, "left pos is > right pos");
+        return query(left, right, roots[version], 0, len - 1);
+    }
+
+    // preallocates node storage for the given number of future mutations
+    void reserve(const usize mutations) {
+        nodes.reserve(
+            std::size(nodes) + mutations * (std::bit_width<u32>(len) + 1)
+        );
+    }
+
+    usize versions() const {
+        return std::size(roots);
+    }
+
+    usize size() const {
+        return len;
+    }
+
+private:
+    struct Node {
+        Val val;
+        u32 left, right;
+    };
+
+    // node 0 stands for every all-nil subtree, so a missing child is just 0
+    IndexAllocator<Node> nodes;
+    std::vector<u32> roots;
+    const Val nil;
+    const i32 len;
+    static constexpr auto op = Op();
+
+    template <typename T>
+        requires IndexableContainer<T>
+                 && std::assignable_from<Val&, decltype(T()[0])>
+    u32 build(const T& source, const i32 l, const i32 r) {
+        if (l == r) {
+            return nodes.alloc(Val(source[l]), 0u, 0u);
+        }
+        const i32 m = l + (r - l) / 2;
+        const u32 lc = build(source, l, m);
+        const u32 rc = build(source, m + 1, r);
+        return nodes.alloc(op(nodes[lc].val, nodes[rc].val), lc, rc);
+    }
+
+    template <bool replace>
+    u32 mutate(
+        const u32 idx, const i32 u, const Val& w, const i32 l, const i32 r
+    ) {
+        if (l == r) {
+            if constexpr (replace) {
+                return nodes.alloc(w, 0u, 0u);
+            } else {
+                return nodes.alloc(op(nodes[idx].val, w), 0u, 0u);
+            }
+        }
+        const i32 m = l + (r - l) / 2;
+        u32 lc = nodes[idx].left, rc = nodes[idx].right;
+        if (u <= m) {
+            lc = mutate<replace>(lc, u, w, l, m);
+        } else {
+            rc = mutate<replace>(rc, u, w, m + 1, r);
+        }
+        return nodes.alloc(op(nodes[lc].val, nodes[rc].val), lc, rc);
+    }
+
+    Val query(const i32 u, const i32 v, const u32 idx, const i32 l, const i32 r)
+        const {
+        if (u > r || v < l) {
+            return nil;
+        }
+        if (u <= l && v >= r) {
+            return nodes[idx].val;
+        }
+        const i32 m = l + (r - l) / 2;
+        return op(
+            query(u, v, nodes[idx].left, l, m),
+            query(u, v, nodes[idx].right, m + 1, r)
+        );
+    }
 };
 
-template <typename Val, usize Size, typename Op = std::plus<>>
+// covers every position in [lo, hi) but only creates the O(log(hi - lo))
+// nodes on the path of each mutated position; with max_nodes > 0, set and
+// update return false instead of growing past that many nodes
+template <typename Val, typename Op = std::plus<>>
+    requires std::is_invocable_r_v<Val, Op, Val, Val>
+             && std::assignable_from<Val&, Val>
+class SparseSegTree {
+public:
+    SparseSegTree(
+        const i64 lo,
+        const i64 hi,
+        const Val& nil_value = Val(),
+        const usize max_nodes = 0
+    )
+        : root(0),
+          nil(nil_value),
+          low(lo),
+          high(hi - 1),
+          cap(max_nodes) {
+        debug_assert(lo < hi, "range must not be empty");
+        if (cap > 0) {
+            nodes.reserve(cap + 1);
+        }
+        nodes.alloc(nil, 0u, 0u);
+    }
+
+    bool set(const i64 pos, const Val& value) {
+        return mutate<true>(pos, value);
+    }
+
+    bool update(const i64 pos, const Val& value) {
+        return mutate<false>(pos, value);
+    }
+
+    Val query(const i64 left, const i64 right) const {
+        debug_assert(low <= left && left <= high, "left pos is invalid");
+        debug_assert(low <= right && right <= high, "right pos is invalid");
+        debug_assert(left <= right, "left pos is > right pos");
+        return query(left, right, root, low, high);
+    }
+
+    // number of nodes created so far
+    usize node_count() const {
+        return std::size(nodes) - 1;
+    }
+
+private:
+    struct Node {
+        Val val;
+        u32 left, right;
+    };
+
+    // node 0 stands for every untouched subtree, so a missing child is just 0
+    IndexAllocator<Node> nodes;
+    u32 root;
+    const Val nil;
+    const i64 low, high;
+    const usize cap;
+    static constexpr auto op = Op();
+
+    template <bool replace> bool mutate(const i64 pos, const Val& value) {
+        debug_assert(low <= pos && pos <= high, "pos is invalid");
+        if (cap > 0 && node_count() + missing(pos) > cap) {
+            return false;
+        }
+        root = mutate<replace>(root, pos, value, low, high);
+        return true;
+    }
+
+    // nodes that mutating pos would create
+    usize missing(const i64 pos) const {
+        usize count = 0;
+        u32 idx = root;
+        i64 l = low, r = high;
+        while (true) {
+            count += idx == 0;
+            if (l == r) {
+                return count;
+            }
+            const i64 m = std::midpoint(l, r);
+            if (pos <= m) {
+                idx = nodes[idx].left;
+                r = m;
+            } else {
+                idx = nodes[idx].right;
+                l = m + 1;
+            }
+        }
+    }
+
+    template <bool replace>
+    u32 mutate(
+        u32 idx, const i64 u, const Val& w, const i64 l, const i64 r
+    ) {
+        if (idx == 0) {
+            idx = nodes.alloc(nil, 0u, 0u);
+        }
+        if (l == r) {
+            if constexpr (replace) {
+                nodes[idx].val = w;
+            } else {
+                nodes[idx].val = op(nodes[idx].val, w);
+            }
+            return idx;
+        }
+        // midpoint avoids overflowing r - l on ranges wider than 2^63
+        const i64 m = std::midpoint(l, r);
+        if (u <= m) {
+            const u32 child = mutate<replace>(nodes[idx].left, u, w, l, m);
+            nodes[idx].left = child;
+        } else {
+            const u32 child = mutate<replace>(nodes[idx].right, u, w, m + 1, r);
+            nodes[idx].right = child;
+        }
+        const auto& node = nodes[idx];
+        nodes[idx].val = op(nodes[node.left].val, nodes[node.right].val);
+        return idx;
+    }
+
+    Val query(const i64 u, const i64 v, const u32 idx, const i64 l, const i64 r)
+        const {
+        if (idx == 0 || u > r || v < l) {
+            return nil;
+        }
+        if (u <= l && v >= r) {
+            return nodes[idx].val;
+        }
+        const i64 m = std::midpoint(l, r);
+        return op(
+            query(u, v, nodes[idx].left, l, m),
+            query(u, v, nodes[idx].right, m + 1, r)
+        );
+    }
+};
+
+template <typename Val, typename Op = std::plus<>>
+    requires std::is_invocable_r_v<Val, Op, Val, Val>
+             && std::assignable_from<Val&, Val>
+class IterativeSegTree {
+public:
+    IterativeSegTree(const usize size, const Val& nil_value = Val())
+        : store(2 * std::bit_ceil(size), nil_value),
+          nil(nil_value),
+          len(size),
+          cap(std::bit_ceil(size)) {}
+
+    template <typename T>
+        requires IndexableContainer<T>
+                     && std::assignable_from<Val&, decltype(T()[0])>
+    IterativeSegTree(const T& source, const Val& nil_value = Val())
+        : store(2 * std::bit_ceil(std::size(source)), nil_value),
+          nil(nil_value),
+          len(std::ssize(source)),
+          cap(std::bit_ceil(std::size(source))) {
+        for (i32 i = 0; i < len; ++i) {
+            store[cap + i] = source[i];
+        }
+        for (i32 i = cap - 1; i > 0; --i) {
+            store[i] = op(store[2 * i], store[2 * i + 1]);
+        }
+    }
+
+    void set(const i32 pos, const Val& value) {
+        debug_assert(0 <= pos && pos < std::ssize(*this), "pos is invalid");
+        i32 idx = pos + cap;
+        store[idx] = value;
+        pull(idx);
+    }
+
+    void update(const i32 pos, const Val& value) {
+        debug_assert(0 <= pos && pos < std::ssize(*this), "pos is invalid");
+        i32 idx = pos + cap;
+        store[idx] = op(store[idx], value);
+        pull(idx);
+    }
+
+    Val query(const i32 left, const i32 right) const {
+        debug_assert(
+            0 <= left && left < std::ssize(*this), "left pos is invalid"
+        );
+        debug_assert(
+            0 <= right && right < std::ssize(*this), "right pos is invalid"
+        );
+        debug_assert(left <= right, "left pos is > right pos");
+        // the two sides are accumulated separately so Op needn't commute
+        Val left_acc = nil, right_acc = nil;
+        for (i32 l = left + cap, r = right + cap + 1; l < r; l /= 2, r /= 2) {
+            if (l & 1) {
+                left_acc = op(left_acc, store[l++]);
+            }
+            if (r & 1) {
+                right_acc = op(store[--r], right_acc);
+            }
+        }
+        return op(left_acc, right_acc);
+    }
+
+    i32 max_right(const i32 left, const auto& pred) const {
+        debug_assert(
+            0 <= left && left <= std::ssize(*this), "left pos is invalid"
+        );
+        debug_assert(pred(nil), "pred must hold for nil");
+        if (left == len) {
+            return left - 1;
+        }
+        Val acc = nil;
+        i32 idx = left + cap;
+        do {
+            while (idx % 2 == 0) {
+                idx /= 2;
+            }
+            if (!pred(op(acc, store[idx]))) {
+                while (idx < cap) {
+                    idx *= 2;
+                    if (pred(op(acc, store[idx]))) {
+                        acc = op(acc, store[idx]);
+                        ++idx;
+                    }
+                }
+                return idx - cap - 1;
+            }
+            acc = op(acc, store[idx]);
+            ++idx;
+        } while (!std::has_single_bit(static_cast<u32>(idx)));
+        return len - 1;
+    }
+
+    i32 min_left(const i32 right, const auto& pred) const {
+        debug_assert(
+            -1 <= right && right < std::ssize(*this), "right pos is invalid"
+        );
+        debug_assert(pred(nil), "pred must hold for nil");
+        if (right == -1) {
+            return 0;
+        }
+        Val acc = nil;
+        i32 idx = right + cap + 1;
+        do {
+            --idx;
+            while (idx > 1 && idx % 2 == 1) {
+                idx /= 2;
+            }
+            if (!pred(op(store[idx], acc))) {
+                while (idx < cap) {
+                    idx = 2 * idx + 1;
+                    if (pred(op(store[idx], acc))) {
+                        acc = op(store[idx], acc);
+                        --idx;
+                    }
+                }
+                return idx + 1 - cap;
+            }
+            acc = op(store[idx], acc);
+        } while (!std::has_single_bit(static_cast<u32>(idx)));
+        return 0;
+    }
+
+    usize size() const {
+        return len;
+    }
+
+private:
+    std::vector<Val> store;
+    const Val nil;
+    const i32 len;
+    const i32 cap;
+    static constexpr auto op = Op();
+
+    void pull(i32 idx) {
+        for (idx /= 2; idx > 0; idx /= 2) {
+            store[idx] = op(store[2 * idx], store[2 * idx + 1]);
+        }
+    }
+};
+
+template <
+    typename Val,
+    usize Size,
+    typename Op = std::plus<>,
+    SegTreeLayout layout = SegTreeLayout::PreOrder>
     requires std::is_invocable_r_v<Val, Op, Val, Val>
              && std::assignable_from<Val&, Val>
 class StaticSegTree {
@@ -167,15 +1037,53 @@ public:
         return query(left, right, 0, 0, Size - 1);
     }
 
+    i32 max_right(const i32 left, const auto& pred) const {
+        debug_assert(
+            0 <= left && left <= std::ssize(*this), "left pos is invalid"
+        );
+        debug_assert(pred(nil), "pred must hold for nil");
+        if (left == std::ssize(*this)) {
+            return left - 1;
+        }
+        Val acc = nil;
+        const i32 fail = max_right(left, pred, acc, 0, 0, Size - 1);
+        return (fail == -1 ? static_cast<i32>(Size) : fail) - 1;
+    }
+
+    i32 min_left(const i32 right, const auto& pred) const {
+        debug_assert(
+            -1 <= right && right < std::ssize(*this), "right pos is invalid"
+        );
+        debug_assert(pred(nil), "pred must hold for nil");
+        if (right == -1) {
+            return 0;
+        }
+        Val acc = nil;
+        const i32 fail = min_left(right, pred, acc, 0, 0, Size - 1);
+        return fail == -1 ? 0 : fail + 1;
+    }
+
     usize size() const {
         return Size;
     }
 
 private:
     const Val nil;
-    std::array<Val, 2 * Size> store;
+    static constexpr usize STORE_SIZE = layout == SegTreeLayout::Eytzinger
+                                            ? 2 * std::bit_ceil(Size)
+                                            : 2 * Size;
+
+    std::array<Val, STORE_SIZE> store;
     static constexpr auto op = Op();
 
+    static std::tuple<i32, i32, i32> children(i32 idx, i32 l, i32 r) {
+        if constexpr (layout == SegTreeLayout::Eytzinger) {
+            return {2 * idx + 1, 2 * idx + 2, l + (r - l) / 2};
+        } else {
+            return compute_indices(idx, l, r);
+        }
+    }
+
     template <typename T>
         requires IndexableContainer<T>
                  && std::assignable_from<Val&, decltype(T()[0])>
@@ -184,7 +1092,7 @@ private:
             store[idx] = source[l];
             return;
         }
-        auto [lc, rc, m] = compute_indices(idx, l, r);
+        auto [lc, rc, m] = children(idx, l, r);
         build(source, lc, l, m);
         build(source, rc, m + 1, r);
         store[idx] = op(store[lc], store[rc]);
@@ -205,7 +1113,7 @@ private:
             }
             return;
         }
-        auto [lc, rc, m] = compute_indices(idx, l, r);
+        auto [lc, rc, m] = children(idx, l, r);
         if (u <= m) {
             mutate<replace>(u, w, lc, l, m);
         } else {
@@ -222,9 +1130,342 @@ private:
         if (u <= l && v >= r) {
             return store[idx];
         }
-        auto [lc, rc, m] = compute_indices(idx, l, r);
+        auto [lc, rc, m] = children(idx, l, r);
         return op(query(u, v, lc, l, m), query(u, v, rc, m + 1, r));
     }
+    i32 max_right(
+        const i32 u,
+        const auto& pred,
+        Val& acc,
+        const i32 idx,
+        const i32 l,
+        const i32 r
+    ) const {
+        if (r < u) {
+            return -1;
+        }
+        if (u <= l) {
+            const auto combined = op(acc, store[idx]);
+            if (pred(combined)) {
+                acc = combined;
+                return -1;
+            }
+            if (l == r) {
+                return l;
+            }
+        }
+        auto [lc, rc, m] = children(idx, l, r);
+        const i32 fail = max_right(u, pred, acc, lc, l, m);
+        if (fail != -1) {
+            return fail;
+        }
+        return max_right(u, pred, acc, rc, m + 1, r);
+    }
+
+    i32 min_left(
+        const i32 v,
+        const auto& pred,
+        Val& acc,
+        const i32 idx,
+        const i32 l,
+        const i32 r
+    ) const {
+        if (l > v) {
+            return -1;
+        }
+        if (r <= v) {
+            const auto combined = op(store[idx], acc);
+            if (pred(combined)) {
+                acc = combined;
+                return -1;
+            }
+            if (l == r) {
+                return l;
+            }
+        }
+        auto [lc, rc, m] = children(idx, l, r);
+        const i32 fail = min_left(v, pred, acc, rc, m + 1, r);
+        if (fail != -1) {
+            return fail;
+        }
+        return min_left(v, pred, acc, lc, l, m);
+    }
+};
+
+// point update / rectangle query on a rows x cols grid: a bottom-up tree of
+// bottom-up trees in one flat (2 rows) x (2 cols) block; the sides are not
+// kept apart, so Op must be commutative (sum, min, max, ...). Built from a
+// grid it doubles as a static 2D range query structure
+template <typename Val, typename Op = std::plus<>>
+    requires std::is_invocable_r_v<Val, Op, Val, Val>
+             && std::assignable_from<Val&, Val>
+class SegTree2D {
+public:
+    SegTree2D(const usize rows, const usize cols, const Val& nil_value = Val())
+        : store(4 * rows * cols, nil_value),
+          nil(nil_value),
+          n(rows),
+          m(cols) {}
+
+    // source[x][y] is the value at row x, column y
+    template <typename T>
+        requires IndexableContainer<T>
+                     && IndexableContainer<decltype(T()[0])>
+                     && std::assignable_from<Val&, decltype(T()[0][0])>
+    SegTree2D(const T& source, const Val& nil_value = Val())
+        : nil(nil_value),
+          n(std::ssize(source)),
+          m(n > 0 ? std::ssize(source[0]) : 0) {
+        store.assign(4 * n * m, nil);
+        for (i32 x = 0; x < n; ++x) {
+            for (i32 y = 0; y < m; ++y) {
+                at(n + x, m + y) = source[x][y];
+            }
+            for (i32 y = m - 1; y > 0; --y) {
+                at(n + x, y) = op(at(n + x, 2 * y), at(n + x, 2 * y + 1));
+            }
+        }
+        for (i32 x = n - 1; x > 0; --x) {
+            for (i32 y = 1; y < 2 * m; ++y) {
+                at(x, y) = op(at(2 * x, y), at(2 * x + 1, y));
+            }
+        }
+    }
+
+    void set(const i32 x, const i32 y, const Val& value) {
+        debug_assert(0 <= x && x < n, "x is invalid");
+        debug_assert(0 <= y && y < m, "y is invalid");
+        const i32 row = n + x;
+        at(row, m + y) = value;
+        for (i32 col = (m + y) / 2; col > 0; col /= 2) {
+            at(row, col) = op(at(row, 2 * col), at(row, 2 * col + 1));
+        }
+        for (i32 i = row / 2; i > 0; i /= 2) {
+            for (i32 col = m + y; col > 0; col /= 2) {
+                at(i, col) = op(at(2 * i, col), at(2 * i + 1, col));
+            }
+        }
+    }
+
+    void update(const i32 x, const i32 y, const Val& value) {
+        debug_assert(0 <= x && x < n, "x is invalid");
+        debug_assert(0 <= y && y < m, "y is invalid");
+        for (i32 i = n + x; i > 0; i /= 2) {
+            for (i32 col = m + y; col > 0; col /= 2) {
+                at(i, col) = op(at(i, col), value);
+            }
+        }
+    }
+
+    // combination of [x1, x2] x [y1, y2]
+    Val query(const i32 x1, const i32 y1, const i32 x2, const i32 y2) const {
+        debug_assert(0 <= x1 && x2 < n, "x is invalid");
+        debug_assert(0 <= y1 && y2 < m, "y is invalid");
+        debug_assert(x1 <= x2 && y1 <= y2, "rectangle is empty");
+        Val ret = nil;
+        for (i32 l = n + x1, r = n + x2 + 1; l < r; l /= 2, r /= 2) {
+            if (l & 1) {
+                ret = op(ret, query_row(l++, y1, y2));
+            }
+            if (r & 1) {
+                ret = op(ret, query_row(--r, y1, y2));
+            }
+        }
+        return ret;
+    }
+
+    usize rows() const {
+        return n;
+    }
+
+    usize cols() const {
+        return m;
+    }
+
+private:
+    std::vector<Val> store;
+    const Val nil;
+    const i32 n, m;
+    static constexpr auto op = Op();
+
+    Val& at(const i32 x, const i32 y) {
+        return store[2 * x * m + y];
+    }
+
+    const Val& at(const i32 x, const i32 y) const {
+        return store[2 * x * m + y];
+    }
+
+    Val query_row(const i32 row, const i32 y1, const i32 y2) const {
+        Val ret = nil;
+        for (i32 l = m + y1, r = m + y2 + 1; l < r; l /= 2, r /= 2) {
+            if (l & 1) {
+                ret = op(ret, at(row, l++));
+            }
+            if (r & 1) {
+                ret = op(ret, at(row, --r));
+            }
+        }
+        return ret;
+    }
+};
+
+// SegTree2D over a sparse set of points known in advance: the outer tree
+// runs over compressed x, and every node keeps a tree over only the y's of
+// the points below it, for O(n log n) memory in total. All inner trees share
+// one flat store; Op must be commutative
+template <std::totally_ordered Coord, typename Val, typename Op = std::plus<>>
+    requires std::is_invocable_r_v<Val, Op, Val, Val>
+             && std::assignable_from<Val&, Val>
+class OfflineSegTree2D {
+public:
+    OfflineSegTree2D(
+        const std::vector<std::pair<Coord, Coord>>& points,
+        const Val& nil_value = Val()
+    )
+        : xs(finalize(points, &std::pair<Coord, Coord>::first)),
+          ys(finalize(points, &std::pair<Coord, Coord>::second)),
+          nil(nil_value),
+          n(std::size(xs)) {
+        std::vector<std::vector<u32>> cols(2 * n);
+        for (const auto& [x, y] : points) {
+            cols[n + xs.compress(x)].push_back(ys.compress(y));
+        }
+        for (i32 i = n; i < 2 * n; ++i) {
+            std::sort(std::begin(cols[i]), std::end(cols[i]));
+            cols[i].erase(
+                std::unique(std::begin(cols[i]), std::end(cols[i])),
+                std::end(cols[i])
+            );
+        }
+        for (i32 i = n - 1; i > 0; --i) {
+            std::set_union(
+                std::begin(cols[2 * i]),
+                std::end(cols[2 * i]),
+                std::begin(cols[2 * i + 1]),
+                std::end(cols[2 * i + 1]),
+                std::back_inserter(cols[i])
+            );
+        }
+        offsets.assign(2 * n + 1, 0);
+        for (i32 i = 0; i < 2 * n; ++i) {
+            offsets[i + 1] = offsets[i] + std::size(cols[i]);
+        }
+        keys.reserve(offsets.back());
+        for (const auto& col : cols) {
+            keys.insert(std::end(keys), std::begin(col), std::end(col));
+        }
+        store.assign(2 * offsets.back(), nil);
+    }
+
+    // (x, y) must be one of the points given on construction
+    void set(const Coord& x, const Coord& y, const Val& value) {
+        const u32 cy = ys.compress(y);
+        i32 node = n + xs.compress(x);
+        assign(node, cy, value);
+        for (node /= 2; node > 0; node /= 2) {
+            assign(node, cy, op(leaf(2 * node, cy), leaf(2 * node + 1, cy)));
+        }
+    }
+
+    // (x, y) must be one of the points given on construction
+    void update(const Coord& x, const Coord& y, const Val& value) {
+        const u32 cy = ys.compress(y);
+        for (i32 node = n + xs.compress(x); node > 0; node /= 2) {
+            const i32 len = offsets[node + 1] - offsets[node];
+            Val* tree = std::data(store) + 2 * offsets[node];
+            for (i32 idx = len + find(node, cy); idx > 0; idx /= 2) {
+                tree[idx] = op(tree[idx], value);
+            }
+        }
+    }
+
+    // combination of the points in [x1, x2] x [y1, y2]; the bounds needn't
+    // be point coordinates
+    Val query(
+        const Coord& x1, const Coord& y1, const Coord& x2, const Coord& y2
+    ) const {
+        debug_assert(!(x2 < x1) && !(y2 < y1), "rectangle is empty");
+        const u32 yl = ys.lower_bound(y1), yr = ys.upper_bound(y2);
+        Val ret = nil;
+        i32 l = n + xs.lower_bound(x1), r = n + xs.upper_bound(x2);
+        for (; l < r; l /= 2, r /= 2) {
+            if (l & 1) {
+                ret = op(ret, query_node(l++, yl, yr));
+            }
+            if (r & 1) {
+                ret = op(ret, query_node(--r, yl, yr));
+            }
+        }
+        return ret;
+    }
+
+    usize size() const {
+        return n;
+    }
+
+private:
+    const FinalizedCompressor<Coord> xs, ys;
+    // node i owns keys[offsets[i], offsets[i + 1]), the sorted compressed
+    // y's below it, and a bottom-up tree over them at store[2 * offsets[i]]
+    std::vector<u32> offsets, keys;
+    std::vector<Val> store;
+    const Val nil;
+    const i32 n;
+    static constexpr auto op = Op();
+
+    static FinalizedCompressor<Coord> finalize(
+        const std::vector<std::pair<Coord, Coord>>& points,
+        Coord std::pair<Coord, Coord>::*field
+    ) {
+        DeferredCompressor<Coord> compressor;
+        for (const auto& point : points) {
+            compressor.insert(point.*field);
+        }
+        return compressor.finalize();
+    }
+
+    // rank of the first key of node that is >= cy
+    i32 find(const i32 node, const u32 cy) const {
+        const auto first = std::begin(keys) + offsets[node];
+        const auto last = std::begin(keys) + offsets[node + 1];
+        return std::lower_bound(first, last, cy) - first;
+    }
+
+    Val leaf(const i32 node, const u32 cy) const {
+        const i32 len = offsets[node + 1] - offsets[node];
+        const i32 pos = find(node, cy);
+        if (pos == len || keys[offsets[node] + pos] != cy) {
+            return nil;
+        }
+        return store[2 * offsets[node] + len + pos];
+    }
+
+    void assign(const i32 node, const u32 cy, const Val& value) {
+        const i32 len = offsets[node + 1] - offsets[node];
+        Val* tree = std::data(store) + 2 * offsets[node];
+        i32 idx = len + find(node, cy);
+        tree[idx] = value;
+        for (idx /= 2; idx > 0; idx /= 2) {
+            tree[idx] = op(tree[2 * idx], tree[2 * idx + 1]);
+        }
+    }
+
+    Val query_node(const i32 node, const u32 yl, const u32 yr) const {
+        const i32 len = offsets[node + 1] - offsets[node];
+        const Val* tree = std::data(store) + 2 * offsets[node];
+        Val ret = nil;
+        i32 l = len + find(node, yl), r = len + find(node, yr);
+        for (; l < r; l /= 2, r /= 2) {
+            if (l & 1) {
+                ret = op(ret, tree[l++]);
+            }
+            if (r & 1) {
+                ret = op(ret, tree[--r]);
+            }
+        }
+        return ret;
+    }
 };
 
 }; // namespace CppCp
@@ -3,6 +3,7 @@
 
 #include <concepts>
 #include <functional>
+#include <memory>
 #include <type_traits>
 #include <utility>
 
@@ -19,12 +20,21 @@ namespace Treap {
 struct Empty {};
 #endif
 
-template <typename Val, bool is_reversible> struct Node {
+// Handle is how nodes link to each other: raw pointers by default, or
+// IndexHandle for 4-byte links and a 4-byte size
+template <
+    typename Val,
+    bool is_reversible,
+    template <typename> typename Handle = std::add_pointer_t>
+struct Node {
+    using Link = Handle<Node>;
+    using Size = std::conditional_t<std::is_pointer_v<Link>, usize, u32>;
+
     Val val, cum_val;
-    Node* left;
-    Node* right;
+    Link left;
+    Link right;
     i32 priority;
-    usize size;
+    Size size;
 
     [[no_unique_address]] std::conditional_t<is_reversible, bool, Empty> flip;
 
@@ -50,13 +60,16 @@ template <
     typename Allocator = DynamicAllocator<Treap::Node<Val, is_reversible>>>
     requires std::is_invocable_r_v<Val, Op, Val, Val>
              && std::assignable_from<Val&, Val>
-             && is_node_allocator<
+             && is_handle_allocator<
                  Allocator,
-                 Treap::Node<Val, is_reversible>,
+                 allocated_t<Allocator, Val>,
                  Val>
 class ImplicitTreap {
 public:
-    using Node = Treap::Node<Val, is_reversible>;
+    // the allocator picks the handle, e.g. IndexHandleAllocator of a
+    // Treap::Node<Val, is_reversible, IndexHandle> for 4-byte links
+    using Link = allocated_t<Allocator, Val>;
+    using Node = typename std::pointer_traits<Link>::element_type;
 
     ImplicitTreap() : root(nullptr) {}
 
@@ -70,13 +83,14 @@ public:
     }
 
     ~ImplicitTreap() {
-        if (root != nullptr) {
+        // nodes from before a reset_allocator are already gone
+        if (root != nullptr && generation == allocator_generation) {
             erase(0, size() - 1);
         }
     }
 
     ImplicitTreap(const ImplicitTreap& other) : root(nullptr) {
-        walk_inorder(other.root, [&](const Node* node) {
+        walk_inorder(other.root, [&](const Link node) {
             root = merge(root, allocator.alloc(node->val));
         });
     }
@@ -143,7 +157,7 @@ public:
     }
 
     void for_each(const auto& func) const {
-        walk_inorder(root, [&](const Node* node) { func(node->val); });
+        walk_inorder(root, [&](const Link node) { func(node->val); });
     }
 
     auto map(const auto& func) const {
@@ -177,7 +191,7 @@ public:
         const auto [left, rest] = split(root, l_pos);
         const auto [target, right] = split(rest, r_pos - l_pos + 1);
 
-        walk_postorder(target, [&](Node* node) { allocator.dealloc(node); });
+        walk_postorder(target, [&](Link node) { allocator.dealloc(node); });
 
         root = merge(left, right);
     }
@@ -217,16 +231,33 @@ public:
         return safe_get_size(root);
     }
 
+    // forgets the contents without freeing their nodes
+    void release() {
+        root = nullptr;
+        generation = allocator_generation;
+    }
+
+    // frees the nodes of every treap of this type at once; an instance alive
+    // at that point may only be destroyed, or released to be used again
+    static void reset_allocator()
+        requires requires(Allocator& obj) { obj.reset(); }
+    {
+        ++allocator_generation;
+        allocator.reset();
+    }
+
 private:
-    mutable Node* root;
+    mutable Link root;
+    u64 generation = allocator_generation;
 
     static Allocator allocator;
+    static inline u64 allocator_generation = 0;
 
     static constexpr auto op = Op();
 
-    ImplicitTreap(Node* node) : root(node) {}
+    ImplicitTreap(Link node) : root(node) {}
 
-    void propagate(Node* node) const {
+    void propagate(Link node) const {
         if (node == nullptr) {
             return;
         }
@@ -243,7 +274,7 @@ private:
         }
     }
 
-    void update(Node* node) const {
+    void update(Link node) const {
         node->cum_val = node->val;
         node->size = 1;
         for (const auto& child : {node->left, node->right}) {
@@ -255,14 +286,14 @@ private:
         }
     }
 
-    static usize safe_get_size(const Node* node) {
+    static usize safe_get_size(const Link node) {
         if (node == nullptr) {
             return 0;
         }
         return node->size;
     }
 
-    std::pair<Node*, Node*> split(Node* node, const usize size) const {
+    std::pair<Link, Link> split(Link node, const usize size) const {
         debug_assert(
             safe_get_size(node) >= size, "split size must be <= node size"
         );
@@ -284,7 +315,7 @@ private:
         }
     }
 
-    Node* merge(Node* left, Node* right) const {
+    Link merge(Link left, Link right) const {
         if (left == nullptr) {
             return right;
         }
@@ -304,7 +335,7 @@ private:
         }
     }
 
-    Node* get(Node* node, const usize offset) const {
+    Link get(Link node, const usize offset) const {
         propagate(node);
         const usize cur_idx = safe_get_size(node->left);
         if (offset == cur_idx) {
@@ -316,7 +347,7 @@ private:
         }
     }
 
-    void walk_inorder(Node* node, const auto& func) const {
+    void walk_inorder(Link node, const auto& func) const {
         if (node == nullptr) {
             return;
         }
@@ -326,7 +357,7 @@ private:
         walk_inorder(node->right, func);
     }
 
-    void walk_preorder(Node* node, const auto& func) const {
+    void walk_preorder(Link node, const auto& func) const {
         if (node == nullptr) {
             return;
         }
@@ -336,7 +367,7 @@ private:
         walk_preorder(node->right, func);
     }
 
-    void walk_postorder(Node* node, const auto& func) const {
+    void walk_postorder(Link node, const auto& func) const {
         if (node == nullptr) {
             return;
         }
@@ -350,9 +381,9 @@ private:
 template <typename Val, typename Op, bool is_reversible, typename Allocator>
     requires std::is_invocable_r_v<Val, Op, Val, Val>
                  && std::assignable_from<Val&, Val>
-                 && is_node_allocator<
+                 && is_handle_allocator<
                      Allocator,
-                     Treap::Node<Val, is_reversible>,
+                     allocated_t<Allocator, Val>,
                      Val>
 Allocator
     ImplicitTreap<Val, Op, is_reversible, Allocator>::allocator = Allocator();
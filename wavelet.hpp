@@ -0,0 +1,279 @@
+#ifndef CPPCP_WAVELET
+#define CPPCP_WAVELET
+
+#include <algorithm>
+#include <bit>
+#include <concepts>
+#include <utility>
+#include <vector>
+
+#include "compress.hpp"
+#include "concepts.hpp"
+#include "debug.hpp"
+#include "types.hpp"
+
+namespace CppCp {
+
+// static bit sequence with O(1) rank and O(log n) select; every 64-bit word
+// sits next to the number of ones before it, so rank touches one cache line
+class BitVector {
+public:
+    BitVector(const usize size = 0) : blocks(size / 64 + 1), len(size) {}
+
+    void set(const i32 pos) {
+        debug_assert(0 <= pos && pos < std::ssize(*this), "pos is invalid");
+        blocks[pos / 64].bits |= u64(1) << (pos % 64);
+    }
+
+    bool operator[](const i32 pos) const {
+        debug_assert(0 <= pos && pos < std::ssize(*this), "pos is invalid");
+        return blocks[pos / 64].bits >> (pos % 64) & 1;
+    }
+
+    // must be called after the last set and before any rank or select
+    void build() {
+        u32 ones = 0;
+        for (auto& block : blocks) {
+            block.rank = ones;
+            ones += std::popcount(block.bits);
+        }
+    }
+
+    // number of ones in [0, pos)
+    i32 rank1(const i32 pos) const {
+        debug_assert(0 <= pos && pos <= std::ssize(*this), "pos is invalid");
+        const Block& block = blocks[pos / 64];
+        const u64 mask = (u64(1) << (pos % 64)) - 1;
+        return block.rank + std::popcount(block.bits & mask);
+    }
+
+    // number of zeroes in [0, pos)
+    i32 rank0(const i32 pos) const {
+        return pos - rank1(pos);
+    }
+
+    // position of the k-th one, counting from 0
+    i32 select1(const i32 k) const {
+        return select<true>(k);
+    }
+
+    // position of the k-th zero, counting from 0
+    i32 select0(const i32 k) const {
+        return select<false>(k);
+    }
+
+    usize size() const {
+        return len;
+    }
+
+private:
+    struct Block {
+        u64 bits = 0;
+        u32 rank = 0;
+    };
+
+    std::vector<Block> blocks;
+    i32 len;
+
+    template <bool one> i32 ones_before(const i32 block) const {
+        return one ? blocks[block].rank : 64 * block - blocks[block].rank;
+    }
+
+    template <bool one> i32 select(i32 k) const {
+        debug_assert(
+            0 <= k && k < (one ? rank1(len) : rank0(len)), "k is invalid"
+        );
+        // last block with fewer than k + 1 matching bits before it
+        i32 lo = 0, hi = std::ssize(blocks) - 1;
+        while (lo < hi) {
+            const i32 mid = lo + (hi - lo + 1) / 2;
+            if (ones_before<one>(mid) <= k) {
+                lo = mid;
+            } else {
+                hi = mid - 1;
+            }
+        }
+        k -= ones_before<one>(lo);
+        u64 bits = one ? blocks[lo].bits : ~blocks[lo].bits;
+        for (; k > 0; --k) {
+            bits &= bits - 1;
+        }
+        return 64 * lo + std::countr_zero(bits);
+    }
+};
+
+// static sequence answering order statistics over ranges in O(log sigma);
+// values are compressed through a FinalizedCompressor. One passed in is
+// copied, so the matrix agrees with other structures built from it on the
+// compressed indices but does not share its storage. Every level stably
+// partitions the sequence by one bit of the compressed value, zeroes first
+template <std::totally_ordered T> class WaveletMatrix {
+public:
+    template <typename U>
+        requires IndexableContainer<U>
+                     && std::convertible_to<decltype(U()[0]), T>
+    WaveletMatrix(const U& source)
+        : WaveletMatrix(source, compress_all(source)) {}
+
+    // every value of source must have been seen by values
+    template <typename U>
+        requires IndexableContainer<U>
+                     && std::convertible_to<decltype(U()[0]), T>
+    WaveletMatrix(const U& source, const FinalizedCompressor<T>& values)
+        : compressor(values),
+          len(std::ssize(source)),
+          height(std::bit_width(std::max<usize>(std::size(values), 2) - 1)) {
+        std::vector<u32> cur(len), next(len);
+        for (i32 i = 0; i < len; ++i) {
+            cur[i] = compressor.compress(T(source[i]));
+        }
+        levels.assign(height, BitVector(len));
+        zeroes.assign(height, 0);
+        for (i32 h = 0; h < height; ++h) {
+            const i32 bit = height - 1 - h;
+            for (i32 i = 0; i < len; ++i) {
+                if (cur[i] >> bit & 1) {
+                    levels[h].set(i);
+                }
+            }
+            levels[h].build();
+            zeroes[h] = levels[h].rank0(len);
+            i32 zero = 0, one = zeroes[h];
+            for (const u32 x : cur) {
+                next[x >> bit & 1 ? one++ : zero++] = x;
+            }
+            std::swap(cur, next);
+        }
+    }
+
+    // k-th smallest value in [left, right], counting from 0
+    T kth(i32 left, i32 right, i32 k) const {
+        check(left, right);
+        debug_assert(0 <= k && k <= right - left, "k is invalid");
+        u32 ret = 0;
+        ++right;
+        for (i32 h = 0; h < height; ++h) {
+            const i32 l0 = levels[h].rank0(left), r0 = levels[h].rank0(right);
+            ret <<= 1;
+            if (k < r0 - l0) {
+                left = l0;
+                right = r0;
+            } else {
+                k -= r0 - l0;
+                left += zeroes[h] - l0;
+                right += zeroes[h] - r0;
+                ret |= 1;
+            }
+        }
+        return compressor.decompress(ret);
+    }
+
+    // number of values < x in [left, right]
+    i32 rank(const i32 left, const i32 right, const T& x) const {
+        check(left, right);
+        return less(left, right + 1, compressor.lower_bound(x));
+    }
+
+    // number of values equal to x in [left, right]
+    i32 count(const i32 left, const i32 right, const T& x) const {
+        check(left, right);
+        const u32 c = compressor.lower_bound(x);
+        if (c == std::size(compressor) || compressor.decompress(c) != x) {
+            return 0;
+        }
+        return less(left, right + 1, c + 1) - less(left, right + 1, c);
+    }
+
+    // number of values in [lower, upper] in [left, right]
+    i32 range_freq(
+        const i32 left, const i32 right, const T& lower, const T& upper
+    ) const {
+        check(left, right);
+        if (upper < lower) {
+            return 0;
+        }
+        return less(left, right + 1, compressor.upper_bound(upper))
+               - less(left, right + 1, compressor.lower_bound(lower));
+    }
+
+    // position of the k-th occurrence of x, counting from 0, or -1 if x
+    // occurs at most k times
+    i32 select(const T& x, const i32 k) const {
+        debug_assert(0 <= k, "k is invalid");
+        if (len == 0 || count(0, len - 1, x) <= k) {
+            return -1;
+        }
+        const u32 c = compressor.compress(x);
+        i32 pos = 0;
+        for (i32 h = 0; h < height; ++h) {
+            if (c >> (height - 1 - h) & 1) {
+                pos = zeroes[h] + levels[h].rank1(pos);
+            } else {
+                pos = levels[h].rank0(pos);
+            }
+        }
+        pos += k;
+        for (i32 h = height - 1; h >= 0; --h) {
+            if (c >> (height - 1 - h) & 1) {
+                pos = levels[h].select1(pos - zeroes[h]);
+            } else {
+                pos = levels[h].select0(pos);
+            }
+        }
+        return pos;
+    }
+
+    usize size() const {
+        return len;
+    }
+
+private:
+    const FinalizedCompressor<T> compressor;
+    std::vector<BitVector> levels;
+    std::vector<i32> zeroes;
+    const i32 len;
+    const i32 height;
+
+    template <typename U>
+    static FinalizedCompressor<T> compress_all(const U& source) {
+        DeferredCompressor<T> ret;
+        for (i32 i = 0; i < std::ssize(source); ++i) {
+            ret.insert(T(source[i]));
+        }
+        return ret.finalize();
+    }
+
+    void check(const i32 left, const i32 right) const {
+        debug_assert(
+            0 <= left && left < std::ssize(*this), "left pos is invalid"
+        );
+        debug_assert(
+            0 <= right && right < std::ssize(*this), "right pos is invalid"
+        );
+        debug_assert(left <= right, "left pos is > right pos");
+    }
+
+    // number of compressed values < c in [left, right)
+    i32 less(i32 left, i32 right, const u32 c) const {
+        if (c >= std::size(compressor)) {
+            return right - left;
+        }
+        i32 ret = 0;
+        for (i32 h = 0; h < height; ++h) {
+            const i32 l0 = levels[h].rank0(left), r0 = levels[h].rank0(right);
+            if (c >> (height - 1 - h) & 1) {
+                ret += r0 - l0;
+                left += zeroes[h] - l0;
+                right += zeroes[h] - r0;
+            } else {
+                left = l0;
+                right = r0;
+            }
+        }
+        return ret;
+    }
+};
+
+} // namespace CppCp
+
+#endif
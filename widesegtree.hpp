@@ -0,0 +1,225 @@
+#ifndef CPPCP_WIDESEGTREE
+#define CPPCP_WIDESEGTREE
+
+#include <algorithm>
+#include <bit>
+#include <concepts>
+#include <cstring>
+#include <functional>
+#include <type_traits>
+#include <vector>
+
+#include "concepts.hpp"
+#include "debug.hpp"
+#include "types.hpp"
+
+namespace CppCp {
+
+// widest vector the enabled ISA passes in registers; anything wider would
+// change the calling convention of the Op it goes through
+#ifndef CPPCP_VECTOR_BYTES
+#if defined(__AVX512F__)
+#define CPPCP_VECTOR_BYTES 64
+#elif defined(__AVX__)
+#define CPPCP_VECTOR_BYTES 32
+#else
+#define CPPCP_VECTOR_BYTES 16
+#endif
+#endif
+
+// block reductions use GCC vector extensions, other compilers a scalar loop
+#if defined(__GNUC__) && !defined(__clang__)
+#define CPPCP_WIDESEGTREE_VECTORS
+#endif
+
+// generic over scalars and GCC vector types, so they can be used as the Op of
+// a WideSegTree as well as any other tree
+struct MinOp {
+    template <typename T> constexpr T operator()(const T& a, const T& b) const {
+        return a < b ? a : b;
+    }
+};
+
+struct MaxOp {
+    template <typename T> constexpr T operator()(const T& a, const T& b) const {
+        return a < b ? b : a;
+    }
+};
+
+// B-ary tree where every node is a block of Width children reduced with
+// native-width vector operations; Op must be commutative (sum, min, max, ...)
+// and callable on GCC vector types. Other compilers reduce blocks with a
+// scalar loop
+template <
+    typename Val,
+    typename Op = std::plus<>,
+    usize Width = 64 / sizeof(Val)>
+    requires std::is_arithmetic_v<Val>
+             && std::is_invocable_r_v<Val, Op, Val, Val>
+             && (std::has_single_bit(Width) && Width > 1)
+class WideSegTree {
+public:
+    WideSegTree(const usize size, const Val& nil_value = Val())
+        : nil(nil_value),
+          len(size) {
+        allocate();
+    }
+
+    template <typename T>
+        requires IndexableContainer<T>
+                     && std::assignable_from<Val&, decltype(T()[0])>
+    WideSegTree(const T& source, const Val& nil_value = Val())
+        : nil(nil_value),
+          len(std::ssize(source)) {
+        allocate();
+        for (i32 i = 0; i < len; ++i) {
+            store[i] = source[i];
+        }
+        for (usize k = 1; k + 1 < std::size(offsets); ++k) {
+            // one value per block of the level below, the rest is padding
+            const usize count = (offsets[k] - offsets[k - 1]) / Width;
+            for (usize i = 0; i < count; ++i) {
+                store[offsets[k] + i] = reduce(
+                    std::data(store) + offsets[k - 1] + i * Width
+                );
+            }
+        }
+    }
+
+    void set(const i32 pos, const Val& value) {
+        debug_assert(0 <= pos && pos < std::ssize(*this), "pos is invalid");
+        usize idx = pos;
+        store[idx] = value;
+        for (usize k = 1; k + 1 < std::size(offsets); ++k) {
+            idx /= Width;
+            store[offsets[k] + idx] = reduce(
+                std::data(store) + offsets[k - 1] + idx * Width
+            );
+        }
+    }
+
+    void update(const i32 pos, const Val& value) {
+        debug_assert(0 <= pos && pos < std::ssize(*this), "pos is invalid");
+        // op commutes, so every ancestor absorbs value directly
+        usize idx = pos;
+        for (usize k = 0; k + 1 < std::size(offsets); ++k) {
+            store[offsets[k] + idx] = op(store[offsets[k] + idx], value);
+            idx /= Width;
+        }
+    }
+
+    Val query(const i32 left, const i32 right) const {
+        debug_assert(
+            0 <= left && left < std::ssize(*this), "left pos is invalid"
+        );
+        debug_assert(
+            0 <= right && right < std::ssize(*this), "right pos is invalid"
+        );
+        debug_assert(left <= right, "left pos is > right pos");
+        Val acc = nil;
+        i32 l = left, r = right;
+        for (usize k = 0;; ++k) {
+            const Val* level = std::data(store) + offsets[k];
+            const i32 lb = l / Width, rb = r / Width;
+            if (lb == rb) {
+                return op(
+                    acc, reduce(level + lb * Width, l % Width, r % Width)
+                );
+            }
+            acc = op(acc, reduce(level + lb * Width, l % Width, Width - 1));
+            acc = op(acc, reduce(level + rb * Width, 0, r % Width));
+            l = lb + 1;
+            r = rb - 1;
+            if (l > r) {
+                return acc;
+            }
+        }
+    }
+
+    usize size() const {
+        return len;
+    }
+
+private:
+    // lanes per native vector; a block is Width / Lanes of them
+    static constexpr usize Lanes = std::min(
+        Width, std::max<usize>(CPPCP_VECTOR_BYTES / sizeof(Val), 1)
+    );
+#ifdef CPPCP_WIDESEGTREE_VECTORS
+    using Lane = std::conditional_t<
+        sizeof(Val) == 8,
+        i64,
+        std::conditional_t<
+            sizeof(Val) == 4,
+            i32,
+            std::conditional_t<sizeof(Val) == 2, i16, signed char>>>;
+    using Vec [[gnu::vector_size(sizeof(Val) * Lanes)]] = Val;
+    using Mask [[gnu::vector_size(sizeof(Val) * Lanes)]] = Lane;
+#endif
+
+    // level k occupies [offsets[k], offsets[k + 1]); the last level is a
+    // single block, whose reduction is never stored
+    std::vector<Val> store;
+    std::vector<usize> offsets;
+    const Val nil;
+    const i32 len;
+    static constexpr auto op = Op();
+
+    void allocate() {
+        usize total = 0, count = std::max<usize>(len, 1);
+        while (true) {
+            const usize padded = (count + Width - 1) / Width * Width;
+            offsets.push_back(total);
+            total += padded;
+            if (padded == Width) {
+                break;
+            }
+            count = padded / Width;
+        }
+        offsets.push_back(total);
+        store.assign(total, nil);
+    }
+
+#ifdef CPPCP_WIDESEGTREE_VECTORS
+    // rotate-and-combine halving; the masks are compile-time constants
+    static Val fold(Vec values) {
+        for (usize shift = Lanes / 2; shift > 0; shift /= 2) {
+            Mask rotation;
+            for (usize i = 0; i < Lanes; ++i) {
+                rotation[i] = (i + shift) % Lanes;
+            }
+            values = op(values, __builtin_shuffle(values, rotation));
+        }
+        return values[0];
+    }
+#endif
+
+    static Val reduce(const Val* block) {
+#ifdef CPPCP_WIDESEGTREE_VECTORS
+        if constexpr (Lanes > 1) {
+            Vec acc, next;
+            std::memcpy(&acc, block, sizeof(Vec));
+            for (usize i = Lanes; i < Width; i += Lanes) {
+                std::memcpy(&next, block + i, sizeof(Vec));
+                acc = op(acc, next);
+            }
+            return fold(acc);
+        }
+#endif
+        return reduce(block, 0, Width - 1);
+    }
+
+    static Val reduce(const Val* block, const i32 from, const i32 to) {
+        // partial blocks are short on average, and a lane mask needs 64-bit
+        // compares that baseline x86-64 lacks
+        Val ret = block[from];
+        for (i32 i = from + 1; i <= to; ++i) {
+            ret = op(ret, block[i]);
+        }
+        return ret;
+    }
+};
+
+} // namespace CppCp
+
+#endif